@@ -0,0 +1,301 @@
+#!/usr/bin/env python3
+#
+# Copyright © 2026 wlgears contributors
+#
+# SPDX-License-Identifier: MIT
+
+"""Runs wlgears over a matrix of options and window sizes.
+
+Each configuration runs for a fixed duration against a headless
+compositor spawned for the benchmark, and the frame rate and frame time
+statistics printed by wlgears are collected into one JSON report plus a
+markdown table.
+
+The compositor command can be replaced with WLGEARS_COMPOSITOR, where
+{socket}, {width} and {height} are substituted. When WLGEARS_COMPOSITOR
+is empty, the compositor of the current WAYLAND_DISPLAY is used instead.
+
+With --baseline (or WLGEARS_BASELINE), the results are compared against
+a previous report. Results are matched by renderer and options, so only
+runs on the same GPU and driver are compared, and the script exits with
+a non-zero status when throughput or frame time percentiles regress
+beyond the tolerances.
+"""
+
+import argparse
+import itertools
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+
+DEFAULT_COMPOSITOR = ('weston --backend=headless --renderer=gl '
+                      '--socket={socket} --width={width} --height={height} '
+                      '--idle-time=0')
+
+# The options of wlgears swept by the benchmark
+OPTIONS = [
+    [],
+    ['-b'],
+    ['-s'],
+    ['-o'],
+    ['-b', '-o'],
+    ['-d', '2000'],
+]
+SIZES = ['400x400', '1280x720']
+# Fullscreen ignores the window size, so it runs once at the output size
+OUTPUT_SIZE = (1920, 1080)
+
+SUMMARY_RE = re.compile(r'^summary: (\d+) frames in ([\d.]+) seconds = ([\d.]+) FPS')
+FRAME_TIME_RE = re.compile(r'^frame time: mean ([\d.]+) ms, p50 ([\d.]+) ms, '
+                           r'p90 ([\d.]+) ms, p99 ([\d.]+) ms, max ([\d.]+) ms')
+CPU_RE = re.compile(r'^cpu time: ([\d.]+) seconds, ([\d.]+) ms/frame, '
+                    r'([\d.]+) frames/CPU-second')
+RENDERER_RE = re.compile(r'^renderer: (.*)$')
+
+# The frame time statistics checked against the baseline
+GATED_FRAME_TIMES = ('p50', 'p90', 'p99')
+
+
+def configurations():
+    for options, size in itertools.product(OPTIONS, SIZES):
+        yield options + ['--size', size]
+    for options in OPTIONS:
+        yield options + ['-f']
+
+
+class Compositor:
+    """A headless compositor running for the duration of the benchmark."""
+
+    def __init__(self, command):
+        self.process = None
+        self.env = dict(os.environ)
+        if command == '':
+            return
+
+        if 'XDG_RUNTIME_DIR' not in self.env:
+            self.runtime_dir = tempfile.TemporaryDirectory(prefix='wlgears-')
+            self.env['XDG_RUNTIME_DIR'] = self.runtime_dir.name
+
+        socket = 'wlgears-bench-%d' % os.getpid()
+        args = shlex.split(command.format(socket=socket,
+                                          width=OUTPUT_SIZE[0],
+                                          height=OUTPUT_SIZE[1]))
+        self.process = subprocess.Popen(args, env=self.env,
+                                        stdout=subprocess.DEVNULL,
+                                        stderr=subprocess.DEVNULL)
+        self.env['WAYLAND_DISPLAY'] = socket
+
+        path = os.path.join(self.env['XDG_RUNTIME_DIR'], socket)
+        deadline = time.monotonic() + 10
+        while not os.path.exists(path):
+            if self.process.poll() is not None or time.monotonic() > deadline:
+                sys.exit('failed to start the compositor: ' + command)
+            time.sleep(0.05)
+
+    def close(self):
+        if self.process:
+            self.process.terminate()
+            self.process.wait()
+
+
+def run(wlgears, options, duration, env):
+    args = [wlgears, '--duration', str(duration)] + options
+    try:
+        proc = subprocess.run(args, env=env, capture_output=True, text=True,
+                              timeout=duration + 30)
+    except subprocess.TimeoutExpired:
+        return {'options': options, 'error': 'timeout'}
+
+    result = {'options': options}
+    for line in proc.stdout.splitlines():
+        m = SUMMARY_RE.match(line)
+        if m:
+            result['frames'] = int(m.group(1))
+            result['seconds'] = float(m.group(2))
+            result['fps'] = float(m.group(3))
+        m = FRAME_TIME_RE.match(line)
+        if m:
+            for key, value in zip(('mean', 'p50', 'p90', 'p99', 'max'),
+                                  m.groups()):
+                result['frame_time_' + key] = float(value)
+        m = CPU_RE.match(line)
+        if m:
+            result['cpu_seconds'] = float(m.group(1))
+            result['cpu_ms_per_frame'] = float(m.group(2))
+            result['frames_per_cpu_second'] = float(m.group(3))
+        m = RENDERER_RE.match(line)
+        if m:
+            result['renderer'] = m.group(1)
+
+    if proc.returncode != 0:
+        result['error'] = 'exit status %d' % proc.returncode
+    elif 'fps' not in result:
+        result['error'] = 'no summary'
+    return result
+
+
+def markdown(results):
+    lines = [
+        '| options | renderer | FPS | mean ms | p50 ms | p90 ms | p99 ms | max ms '
+        '| CPU ms/frame |',
+        '|---|---|---:|---:|---:|---:|---:|---:|---:|',
+    ]
+    for r in results:
+        options = ' '.join(r['options'])
+        if 'error' in r:
+            lines.append('| %s | | error: %s | | | | | | |' % (options, r['error']))
+            continue
+        lines.append('| %s | %s | %.1f | %.3f | %.3f | %.3f | %.3f | %.3f | %s |' % (
+            options, r.get('renderer', ''), r['fps'], r['frame_time_mean'],
+            r['frame_time_p50'], r['frame_time_p90'], r['frame_time_p99'],
+            r['frame_time_max'],
+            '%.3f' % r['cpu_ms_per_frame'] if 'cpu_ms_per_frame' in r else ''))
+    return '\n'.join(lines) + '\n'
+
+
+def result_key(result):
+    return (result.get('renderer', ''), tuple(result['options']))
+
+
+def compare(results, baseline, fps_tolerance, frame_time_tolerance):
+    """Compares results against a baseline report.
+
+    Returns a list of (result, baseline result, regressions), where the
+    baseline result is None when the baseline lacks the configuration.
+    A failed run is a regression of its configuration. It is matched by
+    its options alone when it failed before printing the renderer.
+    """
+    base = {result_key(r): r for r in baseline['results'] if 'error' not in r}
+    base_options = {tuple(r['options']): r for r in base.values()}
+    comparisons = []
+    for r in results:
+        b = base.get(result_key(r))
+        if 'error' in r:
+            if b is None and 'renderer' not in r:
+                b = base_options.get(tuple(r['options']))
+            comparisons.append((r, b, ['error: ' + r['error']] if b else []))
+            continue
+        if b is None:
+            comparisons.append((r, None, []))
+            continue
+
+        regressions = []
+        if r['fps'] < b['fps'] * (1 - fps_tolerance / 100):
+            regressions.append('FPS %.1f -> %.1f' % (b['fps'], r['fps']))
+        for stat in GATED_FRAME_TIMES:
+            key = 'frame_time_' + stat
+            if r[key] > b[key] * (1 + frame_time_tolerance / 100):
+                regressions.append('%s %.3f -> %.3f ms' % (stat, b[key], r[key]))
+        comparisons.append((r, b, regressions))
+    return comparisons
+
+
+def comparison_markdown(comparisons):
+    lines = [
+        '| options | renderer | FPS | baseline FPS | p99 ms | baseline p99 ms | status |',
+        '|---|---|---:|---:|---:|---:|---|',
+    ]
+    for r, b, regressions in comparisons:
+        options = ' '.join(r['options'])
+        if b is None or 'error' in r:
+            lines.append('| %s | %s | | %s | | %s | %s |' % (
+                options, r.get('renderer', ''),
+                '%.1f' % b['fps'] if b else '',
+                '%.3f' % b['frame_time_p99'] if b else '',
+                'REGRESSION: ' + r['error'] if 'error' in r and b else
+                r.get('error', 'no baseline')))
+            continue
+        lines.append('| %s | %s | %.1f | %.1f | %.3f | %.3f | %s |' % (
+            options, r.get('renderer', ''), r['fps'], b['fps'],
+            r['frame_time_p99'], b['frame_time_p99'],
+            'REGRESSION: ' + ', '.join(regressions) if regressions else 'ok'))
+    return '\n'.join(lines) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--wlgears',
+                        help='path to the wlgears executable')
+    parser.add_argument('--output', default='bench-report',
+                        help='report path without extension')
+    parser.add_argument('--duration', type=float, default=5.0,
+                        help='seconds per configuration')
+    parser.add_argument('--baseline',
+                        default=os.environ.get('WLGEARS_BASELINE'),
+                        help='report to compare the results against')
+    parser.add_argument('--results',
+                        help='compare this report instead of running')
+    parser.add_argument('--fps-tolerance', type=float, default=5.0,
+                        help='allowed FPS drop in percent')
+    parser.add_argument('--frame-time-tolerance', type=float, default=10.0,
+                        help='allowed frame time percentile growth in percent')
+    parser.add_argument('extra', nargs='*',
+                        help='options passed to every run, after --')
+    args = parser.parse_args()
+
+    if args.results:
+        with open(args.results) as f:
+            results = json.load(f)['results']
+        return gate(results, args)
+
+    if not args.wlgears:
+        parser.error('--wlgears is required unless --results is given')
+
+    command = os.environ.get('WLGEARS_COMPOSITOR', DEFAULT_COMPOSITOR)
+    compositor = Compositor(command)
+    results = []
+    failed = False
+    try:
+        for options in configurations():
+            result = run(args.wlgears, args.extra + options, args.duration,
+                         compositor.env)
+            failed |= 'error' in result
+            print('%-40s %s' % (' '.join(result['options']),
+                                result.get('error') or
+                                '%.1f FPS' % result['fps']), flush=True)
+            results.append(result)
+    finally:
+        compositor.close()
+
+    with open(args.output + '.json', 'w') as f:
+        json.dump({'duration': args.duration, 'results': results}, f, indent=2)
+    with open(args.output + '.md', 'w') as f:
+        f.write(markdown(results))
+    print('report written to %s.json and %s.md' % (args.output, args.output))
+
+    return gate(results, args) or (1 if failed else 0)
+
+
+def gate(results, args):
+    """Checks the results against the baseline, if any.
+
+    Returns non-zero when a configuration regressed.
+    """
+    if not args.baseline:
+        return 0
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    comparisons = compare(results, baseline, args.fps_tolerance,
+                          args.frame_time_tolerance)
+    table = comparison_markdown(comparisons)
+
+    with open(args.output + '-comparison.md', 'w') as f:
+        f.write(table)
+    print(table, end='')
+
+    matched = sum(1 for _, b, _ in comparisons if b is not None)
+    regressed = sum(1 for _, _, r in comparisons if r)
+    failed = sum(1 for r, _, _ in comparisons if 'error' in r)
+    print('%d of %d configurations matched the baseline, %d regressed, '
+          '%d failed' % (matched, len(comparisons), regressed, failed))
+    return 1 if regressed or failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
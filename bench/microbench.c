@@ -0,0 +1,336 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Microbenchmarks of the CPU side helpers: gear mesh generation, the
+ * matrix functions and the parallel update of the scene state. Each
+ * benchmark runs a number of samples of a fixed iteration count and
+ * reports the median time per call together with the median absolute
+ * deviation of the samples.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gear.h"
+#include "matrix.h"
+#include "pool.h"
+#include "scene.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+/** Keeps the results of the benchmarked calls alive */
+static volatile float sink;
+
+static const int tooth_counts[] = { 8, 16, 32, 64, 128 };
+static const int gear_iterations[] = { 10, 100, 1000 };
+static const int matrix_iterations[] = { 1000, 10000, 100000 };
+static const int thread_counts[] = { 1, 2, 4, 8 };
+static const int update_iterations[] = { 10, 100 };
+
+/** The number of gears updated by the scene_update benchmark */
+#define UPDATE_GEARS 100000
+/** The number of gears handed to a thread at once, as in wlgears */
+#define UPDATE_CHUNK 256
+
+struct benchmark {
+	const char *name;
+	void (*run)(int iterations, int param);
+	/** The name of the parameter, the parameter sweep, NULL for none */
+	const char *param_name;
+	const int *params;
+	int nparams;
+	const int *iterations;
+	int niterations;
+};
+
+static double
+get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+run_create_gear(int iterations, int teeth)
+{
+	struct gear *gear;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		gear = create_gear(1.0, 4.0, 1.0, teeth, 0.7, 0);
+		sink = gear->vertices[gear->nvertices - 1][0];
+		destroy_gear(gear);
+	}
+}
+
+static void
+run_multiply(int iterations, int param)
+{
+	float m[16], r[16];
+	int i;
+
+	identity(m);
+	identity(r);
+	rotate(r, 0.01, 0, 0, 1);
+	for (i = 0; i < iterations; i++)
+		multiply(m, r);
+	sink = m[0];
+}
+
+static void
+run_rotate(int iterations, int param)
+{
+	float m[16];
+	int i;
+
+	identity(m);
+	for (i = 0; i < iterations; i++)
+		rotate(m, 0.01 * i, 0, 0, 1);
+	sink = m[0];
+}
+
+static void
+run_invert(int iterations, int param)
+{
+	float m[16];
+	int i;
+
+	identity(m);
+	rotate(m, 0.5, 0, 1, 0);
+	translate(m, 1.0, 2.0, 3.0);
+	for (i = 0; i < iterations; i++)
+		invert(m);
+	sink = m[0];
+}
+
+static void
+run_frustum(int iterations, int param)
+{
+	float m[16];
+	int i;
+
+	for (i = 0; i < iterations; i++)
+		frustum(m, -1.0, 1.0, -1.0, 1.0, 5.0, 60.0 + i);
+	sink = m[10];
+}
+
+struct update {
+	struct scene_state *state;
+	struct scene_view view;
+};
+
+static void
+update_range(void *data, int begin, int end)
+{
+	struct update *update = data;
+
+	scene_state_update(update->state, &update->view, begin, end);
+}
+
+/**
+ * Updates the matrices of UPDATE_GEARS gears on a pool of threads.
+ */
+static void
+run_scene_update(int iterations, int threads)
+{
+	static struct update update;
+	static struct pool *pool;
+	/* The requested thread count, pool_create() may start fewer */
+	static int pool_size;
+	struct scene_state *state = update.state;
+	int i;
+
+	if (state == NULL) {
+		update.state = state = scene_state_create(UPDATE_GEARS);
+		if (state == NULL) {
+			fprintf(stderr, "failed to allocate the scene state\n");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < UPDATE_GEARS; i++) {
+			state->x[i] = i % 100;
+			state->y[i] = i / 100;
+			state->ratio[i] = i % 2 ? 1.0 : -2.0;
+			state->phase[i] = i % 30;
+		}
+
+		identity(update.view.view);
+		translate(update.view.view, 0, 0, -40.0);
+		rotate(update.view.view, 0.5, 1, 0, 0);
+		frustum(update.view.projection_view, -1.0, 1.0, -1.0, 1.0,
+			5.0, 60.0);
+		multiply(update.view.projection_view, update.view.view);
+		update.view.angle = 30.0;
+	}
+
+	/* Keep the pool between samples, the threads only start once */
+	if (pool == NULL || pool_size != threads) {
+		if (pool)
+			pool_destroy(pool);
+		pool = pool_create(threads);
+		if (pool == NULL) {
+			fprintf(stderr, "failed to create a pool of %d threads\n",
+				threads);
+			exit(EXIT_FAILURE);
+		}
+		pool_size = threads;
+	}
+
+	for (i = 0; i < iterations; i++)
+		pool_run(pool, UPDATE_GEARS, UPDATE_CHUNK, update_range, &update);
+	sink = state->mvp[16 * (UPDATE_GEARS - 1)];
+}
+
+static const struct benchmark benchmarks[] = {
+	{ "create_gear", run_create_gear, "teeth", tooth_counts,
+	  ARRAY_LENGTH(tooth_counts), gear_iterations,
+	  ARRAY_LENGTH(gear_iterations) },
+	{ "multiply", run_multiply, NULL, NULL, 1, matrix_iterations,
+	  ARRAY_LENGTH(matrix_iterations) },
+	{ "rotate", run_rotate, NULL, NULL, 1, matrix_iterations,
+	  ARRAY_LENGTH(matrix_iterations) },
+	{ "invert", run_invert, NULL, NULL, 1, matrix_iterations,
+	  ARRAY_LENGTH(matrix_iterations) },
+	{ "frustum", run_frustum, NULL, NULL, 1, matrix_iterations,
+	  ARRAY_LENGTH(matrix_iterations) },
+	{ "scene_update", run_scene_update, "threads", thread_counts,
+	  ARRAY_LENGTH(thread_counts), update_iterations,
+	  ARRAY_LENGTH(update_iterations) },
+};
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+	const double *da = a, *db = b;
+
+	return (*da > *db) - (*da < *db);
+}
+
+/**
+ * Returns the median of values, reordering them.
+ */
+static double
+median(double *values, int count)
+{
+	qsort(values, count, sizeof(*values), compare_doubles);
+	if (count % 2)
+		return values[count / 2];
+	return (values[count / 2 - 1] + values[count / 2]) / 2.0;
+}
+
+/**
+ * Runs a benchmark and prints the median and the median absolute
+ * deviation of the time per call.
+ */
+static void
+measure(const struct benchmark *b, int param, int iterations, int samples)
+{
+	double *times = calloc(samples, sizeof(*times));
+	double med, mad, start;
+	char name[64];
+	int i;
+
+	/* Warm up the caches and the allocator */
+	b->run(iterations, param);
+
+	for (i = 0; i < samples; i++) {
+		start = get_time_ns();
+		b->run(iterations, param);
+		times[i] = (get_time_ns() - start) / iterations;
+	}
+
+	med = median(times, samples);
+	for (i = 0; i < samples; i++)
+		times[i] = times[i] > med ? times[i] - med : med - times[i];
+	mad = median(times, samples);
+
+	if (b->params)
+		snprintf(name, sizeof name, "%s %s=%d", b->name, b->param_name,
+			 param);
+	else
+		snprintf(name, sizeof name, "%s", b->name);
+	printf("%-24s %10d %14.1f %12.1f\n", name, iterations, med, mad);
+
+	free(times);
+}
+
+static void
+usage(int error_code)
+{
+	fprintf(stderr, "Usage: wlgears-microbench [OPTIONS]\n\n"
+		"  --samples <n>\tNumber of samples per benchmark\n"
+		"  --iterations <n>\tCalls per sample instead of the default sweep\n"
+		"  --filter <name>\tOnly run the benchmarks starting with name\n"
+		"  -h\tThis help text\n\n");
+
+	exit(error_code);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct benchmark *b;
+	const char *filter = NULL;
+	int samples = 31, iterations = 0;
+	int i, j, k;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp("--samples", argv[i]) == 0 && i+1 < argc)
+			samples = atoi(argv[++i]);
+		else if (strcmp("--iterations", argv[i]) == 0 && i+1 < argc)
+			iterations = atoi(argv[++i]);
+		else if (strcmp("--filter", argv[i]) == 0 && i+1 < argc)
+			filter = argv[++i];
+		else if (strcmp("-h", argv[i]) == 0)
+			usage(EXIT_SUCCESS);
+		else
+			usage(EXIT_FAILURE);
+	}
+
+	if (samples < 1 || iterations < 0)
+		usage(EXIT_FAILURE);
+
+	printf("%-24s %10s %14s %12s\n", "benchmark", "iterations",
+	       "median ns/op", "MAD ns/op");
+
+	for (i = 0; i < (int) ARRAY_LENGTH(benchmarks); i++) {
+		b = &benchmarks[i];
+		if (filter && strncmp(b->name, filter, strlen(filter)) != 0)
+			continue;
+
+		for (j = 0; j < b->nparams; j++) {
+			int param = b->params ? b->params[j] : 0;
+
+			if (iterations) {
+				measure(b, param, iterations, samples);
+				continue;
+			}
+			for (k = 0; k < b->niterations; k++)
+				measure(b, param, b->iterations[k], samples);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/*
+ * Generates the meshes of the classic gear train at build time.
+ *
+ * The meshes are created with create_gear(), as at runtime, and written
+ * as constant arrays to a C source file and a header declaring them. With
+ * --indexed, each mesh is written in a compact form of distinct vertices
+ * and 16-bit indices, which wlgears expands when loading the mesh.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gear.h"
+#include "scene.h"
+
+static const char notice[] =
+	"/* Generated by bake-meshes from src/gear.c, do not edit */\n\n";
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: bake-meshes [--indexed] <output.c> <output.h>\n");
+	exit(EXIT_FAILURE);
+}
+
+static FILE *
+open_output(const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	return f;
+}
+
+static void
+close_output(FILE *f, const char *path)
+{
+	if (ferror(f) || fclose(f) != 0) {
+		fprintf(stderr, "%s: write error\n", path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void
+write_vertex(FILE *f, const GearVertex v)
+{
+	int i;
+
+	fprintf(f, "\t");
+	for (i = 0; i < GEAR_VERTEX_STRIDE; i++) {
+		/* 9 digits round-trip a float, "-0" would lose the sign */
+		if (v[i] == 0.0f && signbit(v[i]))
+			fprintf(f, "-0.0,");
+		else
+			fprintf(f, "%.9g,", v[i]);
+		fprintf(f, i + 1 < GEAR_VERTEX_STRIDE ? " " : "\n");
+	}
+}
+
+static void
+write_ints(FILE *f, const char *type, const char *name, int mesh,
+	   const int *values, int count)
+{
+	int i;
+
+	fprintf(f, "static const %s %s_%d[] = {", type, name, mesh);
+	for (i = 0; i < count; i++)
+		fprintf(f, "%s%d,", i % 12 ? " " : "\n\t", values[i]);
+	fprintf(f, "\n};\n\n");
+}
+
+/**
+ * Writes the vertices of a mesh, in the indexed form if indices is not
+ * NULL.
+ *
+ * @return the number of vertices written
+ */
+static int
+write_vertices(FILE *f, int mesh, const struct gear *gear, int *indices)
+{
+	int i, j, count = 0;
+
+	fprintf(f, "static const float vertices_%d[] = {\n", mesh);
+	for (i = 0; i < gear->nvertices; i++) {
+		if (indices) {
+			/* Reuse an earlier identical vertex if there is one */
+			for (j = 0; j < i; j++)
+				if (memcmp(gear->vertices[j], gear->vertices[i],
+					   sizeof(GearVertex)) == 0)
+					break;
+			if (j < i) {
+				indices[i] = indices[j];
+				continue;
+			}
+			indices[i] = count;
+		}
+		write_vertex(f, gear->vertices[i]);
+		count++;
+	}
+	fprintf(f, "};\n\n");
+
+	if (count > 65536) {
+		fprintf(stderr, "bake-meshes: mesh %d has too many vertices "
+			"for 16-bit indices\n", mesh);
+		exit(EXIT_FAILURE);
+	}
+
+	return count;
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct gear_params *params;
+	struct gear *gear, **meshes;
+	const char *c_path, *h_path;
+	bool indexed = false;
+	int *indices = NULL;
+	int i, lod, n = 0, ndistinct;
+	char indices_name[32];
+	FILE *c, *h;
+
+	if (argc == 4 && strcmp(argv[1], "--indexed") == 0)
+		indexed = true;
+	else if (argc != 3)
+		usage();
+	c_path = argv[argc - 2];
+	h_path = argv[argc - 1];
+
+	h = open_output(h_path);
+	fprintf(h, "%s#ifndef BAKED_MESHES_H\n#define BAKED_MESHES_H\n\n"
+		"#include \"scene.h\"\n\n"
+		"extern const struct baked_mesh baked_meshes[];\n"
+		"extern const int baked_mesh_count;\n\n#endif\n", notice);
+	close_output(h, h_path);
+
+	c = open_output(c_path);
+	fprintf(c, "%s#include <stddef.h>\n\n#include \"baked-meshes.h\"\n\n",
+		notice);
+
+	/* The arrays of each mesh, then the table referencing them */
+	meshes = calloc(classic_train_count * GEAR_LOD_COUNT, sizeof *meshes);
+	if (!meshes)
+		goto oom;
+	for (i = 0; i < classic_train_count; i++) {
+		params = &classic_train[i].params;
+		for (lod = 0; lod < GEAR_LOD_COUNT; lod++, n++) {
+			gear = create_gear(params->inner_radius,
+					   params->outer_radius, params->width,
+					   params->teeth, params->tooth_depth,
+					   lod);
+			if (!gear)
+				goto oom;
+			meshes[n] = gear;
+
+			if (indexed) {
+				indices = realloc(indices, gear->nvertices *
+							   sizeof *indices);
+				if (!indices)
+					goto oom;
+			}
+
+			ndistinct = write_vertices(c, n, gear,
+						   indexed ? indices : NULL);
+			if (indexed)
+				write_ints(c, "unsigned short", "indices", n,
+					   indices, gear->nvertices);
+			write_ints(c, "int", "strip_first", n,
+				   gear->strip_first, gear->nstrips);
+			write_ints(c, "int", "strip_count", n,
+				   gear->strip_count, gear->nstrips);
+			fprintf(c, "/* %d vertices, %d distinct */\n\n",
+				gear->nvertices, ndistinct);
+		}
+	}
+
+	fprintf(c, "const struct baked_mesh baked_meshes[] = {\n");
+	for (n = 0; n < classic_train_count * GEAR_LOD_COUNT; n++) {
+		params = &classic_train[n / GEAR_LOD_COUNT].params;
+		gear = meshes[n];
+		if (indexed)
+			snprintf(indices_name, sizeof indices_name,
+				 "indices_%d", n);
+		else
+			strcpy(indices_name, "NULL");
+
+		fprintf(c, "\t{ { %.9g, %.9g, %.9g, %d, %.9g }, %d,\n"
+			"\t  vertices_%d, %s, %d,\n"
+			"\t  strip_first_%d, strip_count_%d, %d, %.9g },\n",
+			params->inner_radius, params->outer_radius,
+			params->width, params->teeth, params->tooth_depth,
+			n % GEAR_LOD_COUNT, n, indices_name, gear->nvertices,
+			n, n, gear->nstrips, gear->radius);
+		destroy_gear(gear);
+	}
+	fprintf(c, "};\n\nconst int baked_mesh_count = %d;\n", n);
+	close_output(c, c_path);
+
+	free(meshes);
+	free(indices);
+
+	return EXIT_SUCCESS;
+
+oom:
+	fprintf(stderr, "bake-meshes: out of memory\n");
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 1999-2001  Brian Paul	All Rights Reserved.
+ * Copyright © 2011 Benjamin Franzke
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * BRIAN PAUL BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gear.h"
+
+#define STRIPS_PER_TOOTH 7
+/*
+ * Including the strip-restart sequences and the two padding vertices that
+ * move the back face and the first outer face to even positions
+ */
+#define VERTICES_PER_TOOTH 48
+/* The inner face strip and its strip-restart sequence */
+#define INNER_FACE_VERTICES 6
+
+/**
+ * Fills a gear vertex.
+ *
+ * @param v the vertex to fill
+ * @param x the x coordinate
+ * @param y the y coordinate
+ * @param z the z coortinate
+ * @param n pointer to the normal table
+ *
+ * @return the operation error code
+ */
+static GearVertex *
+vert(GearVertex *v, float x, float y, float z, float n[3])
+{
+	v[0][0] = x;
+	v[0][1] = y;
+	v[0][2] = z;
+	v[0][3] = n[0];
+	v[0][4] = n[1];
+	v[0][5] = n[2];
+
+	return v + 1;
+}
+
+struct gear *
+create_gear(float inner_radius, float outer_radius, float width,
+	    int teeth, float tooth_depth, int lod)
+{
+	float r0, r1, r2;
+	float da;
+	GearVertex *v;
+	struct gear *gear;
+	double s[5], c[5];
+	float normal[3];
+	int cur_strip_start = 0;
+	int vertices_per_tooth;
+	int i, j;
+
+	/* Allocate memory for the gear */
+	gear = malloc(sizeof *gear);
+	if (gear == NULL)
+		return NULL;
+	gear->static_vertices = false;
+
+	/* Calculate the radii used in the gear */
+	r0 = inner_radius;
+	r1 = outer_radius - tooth_depth / 2.0;
+	r2 = outer_radius + tooth_depth / 2.0;
+
+	gear->radius = sqrt(r2 * r2 + width * width / 4.0);
+
+	if (lod >= 2 && teeth >= 8)
+		teeth /= 2;
+	vertices_per_tooth = VERTICES_PER_TOOTH;
+	if (lod >= 1)
+		vertices_per_tooth -= INNER_FACE_VERTICES;
+
+	da = 2.0 * M_PI / teeth / 4.0;
+
+	/* the first tooth doesn't need the first strip-restart sequence */
+	assert(teeth > 0);
+	gear->nvertices = vertices_per_tooth + (vertices_per_tooth + 2) * (teeth - 1);
+
+	/* Allocate memory for the vertices */
+	gear->vertices = calloc(gear->nvertices, sizeof(*gear->vertices));
+	gear->strip_first = calloc(teeth * STRIPS_PER_TOOTH,
+				   sizeof(*gear->strip_first));
+	gear->strip_count = calloc(teeth * STRIPS_PER_TOOTH,
+				   sizeof(*gear->strip_count));
+	if (!gear->vertices || !gear->strip_first || !gear->strip_count) {
+		destroy_gear(gear);
+		return NULL;
+	}
+	gear->first = 0;
+	gear->nstrips = 0;
+	v = gear->vertices;
+
+	for (i = 0; i < teeth; i++) {
+		/* Calculate needed sin/cos for varius angles */
+		sincos(i * 2.0 * M_PI / teeth, &s[0], &c[0]);
+		sincos(i * 2.0 * M_PI / teeth + da, &s[1], &c[1]);
+		sincos(i * 2.0 * M_PI / teeth + da * 2, &s[2], &c[2]);
+		sincos(i * 2.0 * M_PI / teeth + da * 3, &s[3], &c[3]);
+		sincos(i * 2.0 * M_PI / teeth + da * 4, &s[4], &c[4]);
+
+		/* A set of macros for making the creation of the gears easier */
+#define  GEAR_POINT(r, da) { (r) * c[(da)], (r) * s[(da)] }
+#define  SET_NORMAL(x, y, z) do { \
+	normal[0] = (x); normal[1] = (y); normal[2] = (z); \
+} while(0)
+
+#define  GEAR_VERT(v, point, sign) vert((v), p[(point)].x, p[(point)].y, (sign) * width * 0.5, normal)
+
+/*
+ * Every strip starts at an even position, so that its triangles have the
+ * same winding in the joined strip as when the strip is drawn on its own.
+ */
+#define START_STRIP do { \
+	cur_strip_start = (v - gear->vertices); \
+	if (cur_strip_start) \
+		v += 2 + cur_strip_start % 2; \
+	gear->strip_first[gear->nstrips] = v - gear->vertices; \
+} while(0);
+
+/* emit prev last vertex
+	emit first vertex, twice if padded */
+#define END_STRIP do { \
+	if (cur_strip_start) { \
+		memcpy(gear->vertices + cur_strip_start, \
+				 gear->vertices + (cur_strip_start - 1), sizeof(GearVertex)); \
+		for (j = cur_strip_start + 1; j < gear->strip_first[gear->nstrips]; j++) \
+			memcpy(gear->vertices + j, \
+			       gear->vertices + gear->strip_first[gear->nstrips], \
+			       sizeof(GearVertex)); \
+	} \
+	gear->strip_count[gear->nstrips] = \
+		(v - gear->vertices) - gear->strip_first[gear->nstrips]; \
+	gear->nstrips++; \
+} while (0)
+
+#define QUAD_WITH_NORMAL(p1, p2) do { \
+	SET_NORMAL((p[(p1)].y - p[(p2)].y), -(p[(p1)].x - p[(p2)].x), 0); \
+	v = GEAR_VERT(v, (p1), -1); \
+	v = GEAR_VERT(v, (p1), 1); \
+	v = GEAR_VERT(v, (p2), -1); \
+	v = GEAR_VERT(v, (p2), 1); \
+} while(0)
+
+		struct point {
+			float x;
+			float y;
+		};
+
+		/* Create the 7 points (only x,y coords) used to draw a tooth */
+		struct point p[7] = {
+			GEAR_POINT(r2, 1), // 0
+			GEAR_POINT(r2, 2), // 1
+			GEAR_POINT(r1, 0), // 2
+			GEAR_POINT(r1, 3), // 3
+			GEAR_POINT(r0, 0), // 4
+			GEAR_POINT(r1, 4), // 5
+			GEAR_POINT(r0, 4), // 6
+		};
+
+		/* Front face */
+		START_STRIP;
+		SET_NORMAL(0, 0, 1.0);
+		v = GEAR_VERT(v, 0, +1);
+		v = GEAR_VERT(v, 1, +1);
+		v = GEAR_VERT(v, 2, +1);
+		v = GEAR_VERT(v, 3, +1);
+		v = GEAR_VERT(v, 4, +1);
+		v = GEAR_VERT(v, 5, +1);
+		v = GEAR_VERT(v, 6, +1);
+		END_STRIP;
+
+		/* Back face, in reverse to face away from the front face */
+		START_STRIP;
+		SET_NORMAL(0, 0, -1.0);
+		v = GEAR_VERT(v, 6, -1);
+		v = GEAR_VERT(v, 5, -1);
+		v = GEAR_VERT(v, 4, -1);
+		v = GEAR_VERT(v, 3, -1);
+		v = GEAR_VERT(v, 2, -1);
+		v = GEAR_VERT(v, 1, -1);
+		v = GEAR_VERT(v, 0, -1);
+		END_STRIP;
+
+		/* Outer face */
+		START_STRIP;
+		QUAD_WITH_NORMAL(0, 2);
+		END_STRIP;
+
+		START_STRIP;
+		QUAD_WITH_NORMAL(1, 0);
+		END_STRIP;
+
+		START_STRIP;
+		QUAD_WITH_NORMAL(3, 1);
+		END_STRIP;
+
+		START_STRIP;
+		QUAD_WITH_NORMAL(5, 3);
+		END_STRIP;
+
+		/* Inner face, hardly visible from a distance */
+		if (lod >= 1)
+			continue;
+
+		START_STRIP;
+		SET_NORMAL(-c[0], -s[0], 0);
+		v = GEAR_VERT(v, 4, -1);
+		v = GEAR_VERT(v, 4, 1);
+		SET_NORMAL(-c[4], -s[4], 0);
+		v = GEAR_VERT(v, 6, -1);
+		v = GEAR_VERT(v, 6, 1);
+		END_STRIP;
+	}
+
+	assert(gear->nvertices == (v - gear->vertices));
+
+	return gear;
+}
+
+void
+gear_set_first(struct gear *gear, int first)
+{
+	int i;
+
+	for (i = 0; i < gear->nstrips; i++)
+		gear->strip_first[i] += first - gear->first;
+	gear->first = first;
+}
+
+void
+gear_free_vertices(struct gear *gear)
+{
+	if (!gear->static_vertices)
+		free(gear->vertices);
+	gear->vertices = NULL;
+}
+
+void
+destroy_gear(struct gear *gear)
+{
+	free(gear->strip_first);
+	free(gear->strip_count);
+	if (!gear->static_vertices)
+		free(gear->vertices);
+	free(gear);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 1999-2001  Brian Paul	All Rights Reserved.
+ * Copyright © 2011 Benjamin Franzke
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * BRIAN PAUL BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef GEAR_H
+#define GEAR_H
+
+#include <stdbool.h>
+
+#define GEAR_VERTEX_STRIDE 6
+/** The number of levels of detail of a gear */
+#define GEAR_LOD_COUNT 3
+
+/* Each vertex consist of GEAR_VERTEX_STRIDE float attributes */
+typedef float GearVertex[GEAR_VERTEX_STRIDE];
+
+/**
+ * Struct representing a gear.
+ */
+struct gear {
+	/** The array of vertices comprising the gear */
+	GearVertex *vertices;
+	/** Whether the vertices are constant data, which isn't freed */
+	bool static_vertices;
+	/** The number of vertices comprising the gear */
+	int nvertices;
+	/** The Vertex Buffer Object holding the vertices in the graphics card */
+	unsigned int vbo;
+	/** The index of the first vertex of the gear in the vertex buffer */
+	int first;
+	/**
+	 * The first vertex of each strip in the vertex buffer, leaving out
+	 * the degenerate vertices that join the strips
+	 */
+	int *strip_first;
+	/** The number of vertices of each strip */
+	int *strip_count;
+	/** The number of strips */
+	int nstrips;
+	/** The radius of the bounding sphere around the gear center */
+	float radius;
+};
+
+/**
+ *  Create a gear wheel.
+ *
+ *  @param inner_radius radius of hole at center
+ *  @param outer_radius radius at center of teeth
+ *  @param width width of gear
+ *  @param teeth number of teeth
+ *  @param tooth_depth depth of tooth
+ *  @param lod level of detail, 0 is the full mesh. Level 1 drops the inner
+ *  face and level 2 additionally halves the number of teeth.
+ *
+ *  @return pointer to the constructed struct gear
+ */
+struct gear *
+create_gear(float inner_radius, float outer_radius, float width,
+	    int teeth, float tooth_depth, int lod);
+
+/**
+ * Moves a gear to a position in a shared vertex buffer.
+ *
+ * @param gear the gear to move
+ * @param first the index of the first vertex of the gear in the buffer
+ */
+void
+gear_set_first(struct gear *gear, int first);
+
+/**
+ * Frees the vertices of a gear once they are no longer needed, e.g. after
+ * uploading them. The strips and the bounding radius are kept. Static
+ * vertices are only dropped.
+ */
+void
+gear_free_vertices(struct gear *gear);
+
+/**
+ * Frees a gear and its vertices. The vertex buffer object is left to the
+ * caller.
+ */
+void
+destroy_gear(struct gear *gear);
+
+#endif
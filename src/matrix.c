@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 1999-2001  Brian Paul	All Rights Reserved.
+ * Copyright © 2011 Benjamin Franzke
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * BRIAN PAUL BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix.h"
+
+void
+multiply(float *m, const float *n)
+{
+	float tmp[16];
+	const float *row, *column;
+	div_t d;
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		tmp[i] = 0;
+		d = div(i, 4);
+		row = n + d.quot * 4;
+		column = m + d.rem;
+		for (j = 0; j < 4; j++)
+			tmp[i] += row[j] * column[j * 4];
+	}
+	memcpy(m, &tmp, sizeof tmp);
+}
+
+void
+rotate(float *m, float angle, float x, float y, float z)
+{
+	double s, c;
+
+	sincos(angle, &s, &c);
+	float r[16] = {
+		x * x * (1 - c) + c,	  y * x * (1 - c) + z * s, x * z * (1 - c) - y * s, 0,
+		x * y * (1 - c) - z * s, y * y * (1 - c) + c,	  y * z * (1 - c) + x * s, 0,
+		x * z * (1 - c) + y * s, y * z * (1 - c) - x * s, z * z * (1 - c) + c,	  0,
+		0, 0, 0, 1
+	};
+
+	multiply(m, r);
+}
+
+void
+translate(float *m, float x, float y, float z)
+{
+	float t[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  x, y, z, 1 };
+
+	multiply(m, t);
+}
+
+void
+identity(float *m)
+{
+	float t[16] = {
+		1.0, 0.0, 0.0, 0.0,
+		0.0, 1.0, 0.0, 0.0,
+		0.0, 0.0, 1.0, 0.0,
+		0.0, 0.0, 0.0, 1.0,
+	};
+
+	memcpy(m, t, sizeof(t));
+}
+
+void
+transpose(float *m)
+{
+	float t[16] = {
+		m[0], m[4], m[8],  m[12],
+		m[1], m[5], m[9],  m[13],
+		m[2], m[6], m[10], m[14],
+		m[3], m[7], m[11], m[15]};
+
+	memcpy(m, t, sizeof(t));
+}
+
+void
+invert(float *m)
+{
+	float t[16];
+	identity(t);
+
+	// Extract and invert the translation part 't'. The inverse of a
+	// translation matrix can be calculated by negating the translation
+	// coordinates.
+	t[12] = -m[12]; t[13] = -m[13]; t[14] = -m[14];
+
+	// Invert the rotation part 'r'. The inverse of a rotation matrix is
+	// equal to its transpose.
+	m[12] = m[13] = m[14] = 0;
+	transpose(m);
+
+	// inv(m) = inv(r) * inv(t)
+	multiply(m, t);
+}
+
+void
+frustum(float *m, float l, float r, float b, float t, float n, float f)
+{
+	float tmp[16];
+	identity(tmp);
+
+	float deltaX = r - l;
+	float deltaY = t - b;
+	float deltaZ = f - n;
+
+	tmp[0] = (2 * n) / deltaX;
+	tmp[5] = (2 * n) / deltaY;
+	tmp[8] = (r + l) / deltaX;
+	tmp[9] = (t + b) / deltaY;
+	tmp[10] = -(f + n) / deltaZ;
+	tmp[11] = -1;
+	tmp[14] = -(2 * f * n) / deltaZ;
+	tmp[15] = 0;
+
+	memcpy(m, tmp, sizeof(tmp));
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+/**
+ * The chunks left to a thread, packed as begin << 32 | end so that they
+ * can be taken and stolen with a single compare and swap.
+ */
+struct pool_queue {
+	uint64_t range;
+} __attribute__((aligned(64)));
+
+#define RANGE(begin, end) ((uint64_t) (uint32_t) (begin) << 32 | (uint32_t) (end))
+#define RANGE_BEGIN(range) ((int) ((range) >> 32))
+#define RANGE_END(range) ((int) ((range) & 0xffffffff))
+
+struct pool {
+	int nthreads;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	/** Incremented for each loop handed to the workers */
+	unsigned generation;
+	/** The number of workers still running the current loop */
+	int busy;
+	bool quit;
+
+	/** The queue of each thread, the calling thread's is the last */
+	struct pool_queue *queues;
+	/** The number of the next worker to start, for the queue index */
+	int next_worker;
+
+	/* The current loop */
+	int count, chunk;
+	pool_func func;
+	void *data;
+	int steals;
+};
+
+/**
+ * Takes the first chunk of a queue.
+ *
+ * @return the chunk or -1 if the queue is empty
+ */
+static int
+pop_chunk(struct pool_queue *queue)
+{
+	uint64_t range = __atomic_load_n(&queue->range, __ATOMIC_ACQUIRE);
+	int begin, end;
+
+	do {
+		begin = RANGE_BEGIN(range);
+		end = RANGE_END(range);
+		if (begin >= end)
+			return -1;
+	} while (!__atomic_compare_exchange_n(&queue->range, &range,
+					      RANGE(begin + 1, end), true,
+					      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return begin;
+}
+
+/**
+ * Moves the upper half of the chunks of another thread to a queue.
+ *
+ * @param pool the pool running the loop
+ * @param self the index of the stealing thread
+ *
+ * @return whether chunks were stolen
+ */
+static bool
+steal_chunks(struct pool *pool, int self)
+{
+	struct pool_queue *victim;
+	uint64_t range;
+	int i, begin, end, mid;
+
+	for (i = 1; i < pool->nthreads; i++) {
+		victim = &pool->queues[(self + i) % pool->nthreads];
+		range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+		do {
+			begin = RANGE_BEGIN(range);
+			end = RANGE_END(range);
+			if (begin >= end)
+				break;
+			mid = begin + (end - begin) / 2;
+		} while (!__atomic_compare_exchange_n(&victim->range, &range,
+						      RANGE(begin, mid), true,
+						      __ATOMIC_ACQ_REL,
+						      __ATOMIC_ACQUIRE));
+		if (begin >= end)
+			continue;
+
+		/* Only this thread refills its own, empty queue */
+		__atomic_store_n(&pool->queues[self].range, RANGE(mid, end),
+				 __ATOMIC_RELEASE);
+		__atomic_fetch_add(&pool->steals, end - mid, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Runs chunks of the current loop until no thread has any left.
+ */
+static void
+run_chunks(struct pool *pool, int self)
+{
+	struct pool_queue *queue = &pool->queues[self];
+	int chunk, begin, end;
+
+	do {
+		while ((chunk = pop_chunk(queue)) >= 0) {
+			begin = chunk * pool->chunk;
+			end = begin + pool->chunk;
+			pool->func(pool->data, begin,
+				   end < pool->count ? end : pool->count);
+		}
+	} while (steal_chunks(pool, self));
+}
+
+static void *
+worker_main(void *data)
+{
+	struct pool *pool = data;
+	unsigned generation = 0;
+	int self;
+
+	pthread_mutex_lock(&pool->lock);
+	self = pool->next_worker++;
+	for (;;) {
+		while (pool->generation == generation && !pool->quit)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->quit)
+			break;
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		run_chunks(pool, self);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct pool *
+pool_create(int threads)
+{
+	struct pool *pool;
+	int i;
+
+	pool = calloc(1, sizeof *pool);
+	if (pool == NULL)
+		return NULL;
+
+	pool->nthreads = threads > 0 ? threads : 1;
+	pool->queues = aligned_alloc(sizeof *pool->queues,
+				     pool->nthreads * sizeof *pool->queues);
+	pool->threads = calloc(pool->nthreads, sizeof *pool->threads);
+	if (pool->queues == NULL || pool->threads == NULL) {
+		free(pool->queues);
+		free(pool->threads);
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	/* The calling thread runs loops too */
+	for (i = 0; i < pool->nthreads - 1; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+			pool->nthreads = i + 1;
+			break;
+		}
+	}
+
+	return pool;
+}
+
+void
+pool_destroy(struct pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nthreads - 1; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->start);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool->queues);
+	free(pool);
+}
+
+int
+pool_threads(const struct pool *pool)
+{
+	return pool->nthreads;
+}
+
+int
+pool_run(struct pool *pool, int count, int chunk, pool_func func, void *data)
+{
+	int i, nchunks, share, begin;
+
+	if (count <= 0)
+		return 0;
+	if (chunk < 1)
+		chunk = 1;
+
+	/* Deal the chunks out evenly, the first threads get the remainder */
+	nchunks = (count + chunk - 1) / chunk;
+	share = nchunks / pool->nthreads;
+	begin = 0;
+	for (i = 0; i < pool->nthreads; i++) {
+		int n = share + (i < nchunks % pool->nthreads);
+
+		pool->queues[i].range = RANGE(begin, begin + n);
+		begin += n;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->count = count;
+	pool->chunk = chunk;
+	pool->func = func;
+	pool->data = data;
+	pool->steals = 0;
+	pool->busy = pool->nthreads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_chunks(pool, pool->nthreads - 1);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busy > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	return pool->steals;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef POOL_H
+#define POOL_H
+
+/**
+ * A pool of threads running parallel loops with work stealing.
+ *
+ * The iterations of a loop are split into chunks, and each thread starts
+ * with an equal share of consecutive chunks. A thread that runs out of
+ * chunks steals half of the remaining chunks of another thread, so that
+ * uneven chunks or preempted threads don't hold up the loop.
+ */
+struct pool;
+
+/**
+ * Processes the iterations [begin, end) of a loop.
+ *
+ * @param data the data passed to pool_run()
+ * @param begin the first iteration
+ * @param end the iteration after the last one
+ */
+typedef void (*pool_func)(void *data, int begin, int end);
+
+/**
+ * Creates a pool.
+ *
+ * @param threads the number of threads running loops, including the
+ * calling thread
+ *
+ * @return the pool or NULL on failure
+ */
+struct pool *
+pool_create(int threads);
+
+void
+pool_destroy(struct pool *pool);
+
+/**
+ * Returns the number of threads running loops, including the calling
+ * thread.
+ */
+int
+pool_threads(const struct pool *pool);
+
+/**
+ * Runs a loop on all threads of the pool and waits for it to finish.
+ *
+ * @param pool the pool to run the loop on
+ * @param count the number of iterations
+ * @param chunk the number of iterations handed out at once
+ * @param func the function processing the iterations
+ * @param data the data passed to func
+ *
+ * @return the number of chunks that were stolen
+ */
+int
+pool_run(struct pool *pool, int count, int chunk, pool_func func, void *data);
+
+#endif
@@ -0,0 +1,462 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gear.h"
+#include "scene.h"
+
+/**
+ * The key of a mesh. It has no padding, so keys are hashed and compared
+ * as bytes.
+ */
+struct mesh_key {
+	struct gear_params params;
+	int lod;
+};
+
+struct mesh_cache {
+	/** The meshes and their keys in creation order */
+	struct gear **meshes;
+	struct mesh_key *keys;
+	int count, capacity;
+	/** The open addressing table of mesh indices plus one, 0 if free */
+	int *slots;
+	/** The number of slots, a power of two */
+	int nslots;
+	/** The meshes generated at build time, see mesh_cache_set_baked() */
+	const struct baked_mesh *baked;
+	int nbaked;
+	/** The number of meshes taken from the baked ones */
+	int baked_used;
+};
+
+const struct scene_entry classic_train[] = {
+	{ { 1.0, 4.0, 1.0, 20, 0.7 }, -3.0, -2.0, 1.0, 0.0,
+	  { 0.8, 0.1, 0.0, 1.0 } },
+	{ { 0.5, 2.0, 2.0, 10, 0.7 }, 3.1, -2.0, -2.0, -9.0,
+	  { 0.0, 0.8, 0.2, 1.0 } },
+	{ { 1.3, 2.0, 0.5, 10, 0.7 }, -3.1, 4.2, -2.0, -25.0,
+	  { 0.2, 0.2, 1.0, 1.0 } },
+};
+const int classic_train_count = sizeof classic_train / sizeof classic_train[0];
+
+struct scene_entry *
+scene_load(const char *path, int *count)
+{
+	FILE *f = fopen(path, "r");
+	struct scene_entry *entries = NULL, *e;
+	char line[512], *p;
+	int capacity = 0, n = 0, lineno = 0, end;
+
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof line, f)) {
+		lineno++;
+		p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || *p == '\0')
+			continue;
+
+		if (n == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			e = realloc(entries, capacity * sizeof *entries);
+			if (!e)
+				goto fail;
+			entries = e;
+		}
+
+		e = &entries[n];
+		end = 0;
+		if (sscanf(p, "gear %f %f %f %d %f %f %f %f %f %f %f %f %n",
+			   &e->params.inner_radius, &e->params.outer_radius,
+			   &e->params.width, &e->params.teeth,
+			   &e->params.tooth_depth, &e->x, &e->y, &e->ratio,
+			   &e->phase, &e->color[0], &e->color[1],
+			   &e->color[2], &end) != 12 || p[end] != '\0' ||
+		    e->params.teeth < 1 || e->params.width <= 0 ||
+		    e->params.inner_radius < 0 || e->params.tooth_depth < 0 ||
+		    e->params.outer_radius <= e->params.inner_radius) {
+			fprintf(stderr, "%s:%d: invalid gear: %s", path, lineno, p);
+			goto fail;
+		}
+		e->color[3] = 1.0;
+		n++;
+	}
+
+	if (n == 0) {
+		fprintf(stderr, "%s: no gears\n", path);
+		goto fail;
+	}
+
+	fclose(f);
+	*count = n;
+	return entries;
+
+fail:
+	free(entries);
+	fclose(f);
+	return NULL;
+}
+
+static uint32_t
+hash_key(const struct mesh_key *key)
+{
+	const unsigned char *p = (const unsigned char *) key;
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < sizeof *key; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+
+	return hash;
+}
+
+/**
+ * Returns the slot of a key, which is free if the key is not in the table.
+ */
+static int *
+find_slot(const struct mesh_cache *cache, const struct mesh_key *key)
+{
+	int i = hash_key(key) & (cache->nslots - 1);
+
+	while (cache->slots[i] &&
+	       memcmp(&cache->keys[cache->slots[i] - 1], key, sizeof *key) != 0)
+		i = (i + 1) & (cache->nslots - 1);
+
+	return &cache->slots[i];
+}
+
+/**
+ * Doubles the number of slots of the table.
+ */
+static bool
+grow_slots(struct mesh_cache *cache)
+{
+	int *old = cache->slots, nold = cache->nslots, i;
+
+	cache->nslots *= 2;
+	cache->slots = calloc(cache->nslots, sizeof *cache->slots);
+	if (!cache->slots) {
+		cache->slots = old;
+		cache->nslots = nold;
+		return false;
+	}
+
+	for (i = 0; i < nold; i++)
+		if (old[i])
+			*find_slot(cache, &cache->keys[old[i] - 1]) = old[i];
+	free(old);
+
+	return true;
+}
+
+struct mesh_cache *
+mesh_cache_create(void)
+{
+	struct mesh_cache *cache = calloc(1, sizeof *cache);
+
+	if (!cache)
+		return NULL;
+
+	cache->nslots = 64;
+	cache->slots = calloc(cache->nslots, sizeof *cache->slots);
+	if (!cache->slots) {
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void
+mesh_cache_destroy(struct mesh_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->count; i++)
+		destroy_gear(cache->meshes[i]);
+	free(cache->meshes);
+	free(cache->keys);
+	free(cache->slots);
+	free(cache);
+}
+
+/**
+ * Creates a gear from a baked mesh.
+ *
+ * The vertices are used in place unless they have to be expanded from the
+ * indexed form. The strips are copied, since moving the gear into a
+ * vertex buffer changes them.
+ */
+static struct gear *
+gear_from_baked(const struct baked_mesh *baked)
+{
+	struct gear *gear = calloc(1, sizeof *gear);
+	GearVertex *vertices;
+	int i;
+
+	if (!gear)
+		return NULL;
+
+	gear->nvertices = baked->nvertices;
+	gear->nstrips = baked->nstrips;
+	gear->radius = baked->radius;
+	gear->strip_first = malloc(gear->nstrips * sizeof *gear->strip_first);
+	gear->strip_count = malloc(gear->nstrips * sizeof *gear->strip_count);
+	if (!gear->strip_first || !gear->strip_count) {
+		destroy_gear(gear);
+		return NULL;
+	}
+	memcpy(gear->strip_first, baked->strip_first,
+	       gear->nstrips * sizeof *gear->strip_first);
+	memcpy(gear->strip_count, baked->strip_count,
+	       gear->nstrips * sizeof *gear->strip_count);
+
+	if (!baked->indices) {
+		gear->vertices = (GearVertex *) baked->vertices;
+		gear->static_vertices = true;
+		return gear;
+	}
+
+	vertices = malloc(gear->nvertices * sizeof *vertices);
+	if (!vertices) {
+		destroy_gear(gear);
+		return NULL;
+	}
+	for (i = 0; i < gear->nvertices; i++)
+		memcpy(vertices[i], &baked->vertices[baked->indices[i] *
+						     GEAR_VERTEX_STRIDE],
+		       sizeof vertices[i]);
+	gear->vertices = vertices;
+
+	return gear;
+}
+
+/**
+ * Returns a gear made from the baked mesh matching a key, if any.
+ */
+static struct gear *
+find_baked(struct mesh_cache *cache, const struct mesh_key *key)
+{
+	struct gear *mesh;
+	int i;
+
+	for (i = 0; i < cache->nbaked; i++) {
+		if (cache->baked[i].lod != key->lod ||
+		    memcmp(&cache->baked[i].params, &key->params,
+			   sizeof key->params) != 0)
+			continue;
+
+		mesh = gear_from_baked(&cache->baked[i]);
+		if (mesh)
+			cache->baked_used++;
+		return mesh;
+	}
+
+	return NULL;
+}
+
+void
+mesh_cache_set_baked(struct mesh_cache *cache, const struct baked_mesh *meshes,
+		     int count)
+{
+	cache->baked = meshes;
+	cache->nbaked = count;
+}
+
+int
+mesh_cache_baked_count(const struct mesh_cache *cache)
+{
+	return cache->baked_used;
+}
+
+struct gear *
+mesh_cache_get(struct mesh_cache *cache, const struct gear_params *params,
+	       int lod, int *index, bool *created)
+{
+	struct mesh_key key;
+	struct gear *mesh;
+	void *p;
+	int *slot, capacity;
+
+	memset(&key, 0, sizeof key);
+	key.params = *params;
+	key.lod = lod;
+
+	/* Keep the table at most half full for short probe sequences */
+	if ((cache->count + 1) * 2 > cache->nslots && !grow_slots(cache))
+		return NULL;
+
+	slot = find_slot(cache, &key);
+	if (*slot) {
+		if (index)
+			*index = *slot - 1;
+		if (created)
+			*created = false;
+		return cache->meshes[*slot - 1];
+	}
+
+	/* The capacity only grows once both arrays have grown */
+	if (cache->count == cache->capacity) {
+		capacity = cache->capacity ? cache->capacity * 2 : 16;
+		p = realloc(cache->meshes, capacity * sizeof *cache->meshes);
+		if (!p)
+			return NULL;
+		cache->meshes = p;
+		p = realloc(cache->keys, capacity * sizeof *cache->keys);
+		if (!p)
+			return NULL;
+		cache->keys = p;
+		cache->capacity = capacity;
+	}
+
+	mesh = find_baked(cache, &key);
+	if (!mesh)
+		mesh = create_gear(params->inner_radius, params->outer_radius,
+				   params->width, params->teeth,
+				   params->tooth_depth, lod);
+	if (!mesh)
+		return NULL;
+
+	cache->meshes[cache->count] = mesh;
+	cache->keys[cache->count] = key;
+	*slot = ++cache->count;
+
+	if (index)
+		*index = cache->count - 1;
+	if (created)
+		*created = true;
+	return mesh;
+}
+
+size_t
+mesh_cache_bytes(const struct mesh_cache *cache)
+{
+	const struct gear *gear;
+	size_t bytes;
+	int i;
+
+	bytes = sizeof *cache + cache->nslots * sizeof *cache->slots +
+		cache->capacity * (sizeof *cache->meshes + sizeof *cache->keys);
+
+	for (i = 0; i < cache->count; i++) {
+		gear = cache->meshes[i];
+		bytes += sizeof *gear + gear->nstrips * 2 * sizeof(int);
+		if (gear->vertices && !gear->static_vertices)
+			bytes += gear->nvertices * sizeof(GearVertex);
+	}
+
+	return bytes;
+}
+
+int
+mesh_cache_count(const struct mesh_cache *cache)
+{
+	return cache->count;
+}
+
+struct gear *
+mesh_cache_mesh(const struct mesh_cache *cache, int index)
+{
+	return cache->meshes[index];
+}
+
+struct scene_state *
+scene_state_create(int count)
+{
+	struct scene_state *state = calloc(1, sizeof *state);
+
+	if (state == NULL)
+		return NULL;
+
+	state->count = count;
+	state->x = calloc(count, sizeof *state->x);
+	state->y = calloc(count, sizeof *state->y);
+	state->ratio = calloc(count, sizeof *state->ratio);
+	state->phase = calloc(count, sizeof *state->phase);
+	state->mvp = calloc(count, 16 * sizeof *state->mvp);
+	state->normal = calloc(count, 16 * sizeof *state->normal);
+	if (!state->x || !state->y || !state->ratio || !state->phase ||
+	    !state->mvp || !state->normal) {
+		scene_state_destroy(state);
+		return NULL;
+	}
+
+	return state;
+}
+
+void
+scene_state_destroy(struct scene_state *state)
+{
+	free(state->x);
+	free(state->y);
+	free(state->ratio);
+	free(state->phase);
+	free(state->mvp);
+	free(state->normal);
+	free(state);
+}
+
+void
+scene_state_update(struct scene_state *state, const struct scene_view *view,
+		   int begin, int end)
+{
+	const float *pv = view->projection_view, *v = view->view;
+	float s, c, x, y, *m, *n;
+	int i, r;
+
+	for (i = begin; i < end; i++) {
+		sincosf((state->ratio[i] * view->angle + state->phase[i]) *
+			(float) M_PI / 180.0f, &s, &c);
+		x = state->x[i];
+		y = state->y[i];
+		m = &state->mvp[16 * i];
+		n = &state->normal[16 * i];
+
+		/* projection * view * translate(x, y, 0) * rotate(z) */
+		for (r = 0; r < 4; r++) {
+			m[r] = pv[r] * c + pv[4 + r] * s;
+			m[4 + r] = pv[4 + r] * c - pv[r] * s;
+			m[8 + r] = pv[8 + r];
+			m[12 + r] = pv[r] * x + pv[4 + r] * y + pv[12 + r];
+		}
+
+		/* The same without the projection and the translations */
+		for (r = 0; r < 4; r++) {
+			n[r] = v[r] * c + v[4 + r] * s;
+			n[4 + r] = v[4 + r] * c - v[r] * s;
+			n[8 + r] = v[8 + r];
+			n[12 + r] = 0.0f;
+		}
+		n[15] = 1.0f;
+	}
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Scene description files and a cache sharing gear meshes between gears.
+ *
+ * A scene file lists one gear per line:
+ *
+ *	gear <inner radius> <outer radius> <width> <teeth> <tooth depth>
+ *	     <x> <y> <ratio> <phase> <red> <green> <blue>
+ *
+ * where the gear rotates by ratio * angle + phase degrees. Empty lines
+ * and lines starting with # are ignored.
+ */
+
+/**
+ * The parameters of create_gear(), which identify a mesh.
+ */
+struct gear_params {
+	float inner_radius, outer_radius, width;
+	int teeth;
+	float tooth_depth;
+};
+
+/**
+ * Struct representing a gear of a scene file.
+ */
+struct scene_entry {
+	struct gear_params params;
+	/** The position of the gear */
+	float x, y;
+	/** The rotation of the gear is ratio * angle + phase degrees */
+	float ratio, phase;
+	/** The RGBA color of the gear */
+	float color[4];
+};
+
+/**
+ * The three gears of the classic glxgears train.
+ */
+extern const struct scene_entry classic_train[];
+extern const int classic_train_count;
+
+/**
+ * Loads a scene file.
+ *
+ * Errors are reported on stderr with the offending line.
+ *
+ * @param path the scene file
+ * @param count set to the number of gears
+ *
+ * @return the gears, to be freed by the caller, or NULL on failure
+ */
+struct scene_entry *
+scene_load(const char *path, int *count);
+
+/**
+ * A hash table of gear meshes keyed by their parameters and level of
+ * detail, so that gears with the same parameters share one mesh.
+ */
+struct mesh_cache;
+
+struct mesh_cache *
+mesh_cache_create(void);
+
+/**
+ * Destroys the cache and all meshes in it. Vertex buffer objects are left
+ * to the caller.
+ */
+void
+mesh_cache_destroy(struct mesh_cache *cache);
+
+/**
+ * Returns the mesh of a gear, creating it on the first use.
+ *
+ * @param cache the cache to look the mesh up in
+ * @param params the parameters of the gear
+ * @param lod the level of detail of the mesh
+ * @param index set to the index of the mesh in the cache, if not NULL
+ * @param created set to whether the mesh was just created, if not NULL
+ *
+ * @return the mesh or NULL on failure
+ */
+struct gear *
+mesh_cache_get(struct mesh_cache *cache, const struct gear_params *params,
+	       int lod, int *index, bool *created);
+
+/**
+ * A mesh generated at build time by bake-meshes.
+ *
+ * The vertices either list the vertices of the strips in order, or, in
+ * the compact indexed form, the distinct vertices, which are expanded
+ * through the indices.
+ */
+struct baked_mesh {
+	struct gear_params params;
+	int lod;
+	/** The vertices, 6 floats each */
+	const float *vertices;
+	/** The vertex of each vertex of the strips, NULL if not indexed */
+	const unsigned short *indices;
+	/** The number of vertices of the strips */
+	int nvertices;
+	/** The first vertex and the number of vertices of each strip */
+	const int *strip_first, *strip_count;
+	int nstrips;
+	float radius;
+};
+
+/**
+ * Makes the cache take meshes from the baked ones instead of creating
+ * them when the parameters and level of detail match.
+ *
+ * @param cache the cache to add the baked meshes to
+ * @param meshes the baked meshes, which have to outlive the cache
+ * @param count the number of baked meshes
+ */
+void
+mesh_cache_set_baked(struct mesh_cache *cache, const struct baked_mesh *meshes,
+		     int count);
+
+/**
+ * Returns the number of meshes the cache took from the baked ones.
+ */
+int
+mesh_cache_baked_count(const struct mesh_cache *cache);
+
+/**
+ * Returns the CPU memory taken by the cache and its meshes in bytes.
+ */
+size_t
+mesh_cache_bytes(const struct mesh_cache *cache);
+
+/**
+ * Returns the number of meshes in the cache.
+ */
+int
+mesh_cache_count(const struct mesh_cache *cache);
+
+/**
+ * Returns a mesh by the index set by mesh_cache_get().
+ */
+struct gear *
+mesh_cache_mesh(const struct mesh_cache *cache, int index);
+
+/**
+ * The per-frame state of the gears of a scene, stored as arrays so that
+ * ranges of gears can be updated in parallel and vectorized.
+ */
+struct scene_state {
+	int count;
+	/** The positions of the gears */
+	float *x, *y;
+	/** The rotation of a gear is ratio * angle + phase degrees */
+	float *ratio, *phase;
+	/** The column-major model view projection matrices, 16 per gear */
+	float *mvp;
+	/** The column-major normal matrices, 16 per gear */
+	float *normal;
+};
+
+/**
+ * Creates the state of count gears, with all fields zeroed.
+ *
+ * @return the state or NULL on failure
+ */
+struct scene_state *
+scene_state_create(int count);
+
+void
+scene_state_destroy(struct scene_state *state);
+
+/**
+ * The inputs of scene_state_update(), shared by all gears.
+ */
+struct scene_view {
+	/** The view transformation */
+	float view[16];
+	/** The projection times the view transformation */
+	float projection_view[16];
+	/** The rotation angle of a gear with a ratio of 1, in degrees */
+	float angle;
+};
+
+/**
+ * Computes the matrices of the gears [begin, end).
+ *
+ * The model transformation of a gear is a translation followed by a
+ * rotation about the z axis, so only the first two columns of the view
+ * are rotated, and the normal matrix is the rotation part of the model
+ * view transformation.
+ *
+ * @param state the state to update
+ * @param view the view of the frame
+ * @param begin the first gear
+ * @param end the gear after the last one
+ */
+void
+scene_state_update(struct scene_state *state, const struct scene_view *view,
+		   int begin, int end);
+
+#endif
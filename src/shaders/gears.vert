@@ -0,0 +1,46 @@
+#version 450
+
+/*
+ * Vertex shader of the Vulkan renderer.
+ *
+ * The per-gear placement comes from push constants recorded once into the
+ * command buffers, so only the per-frame uniforms change between frames.
+ */
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+layout(set = 0, binding = 0) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec4 light;
+	/* x is the gear rotation angle in degrees */
+	vec4 angle;
+} frame;
+
+layout(push_constant) uniform Gear {
+	vec4 color;
+	/* x, y position, rotation ratio and phase in degrees */
+	vec4 placement;
+} gear;
+
+layout(location = 0) out vec4 color;
+
+void main()
+{
+	float a = radians(gear.placement.z * frame.angle.x + gear.placement.w);
+	float s = sin(a), c = cos(a);
+	mat4 model = mat4(c, s, 0.0, 0.0,
+			  -s, c, 0.0, 0.0,
+			  0.0, 0.0, 1.0, 0.0,
+			  gear.placement.x, gear.placement.y, 0.0, 1.0);
+	mat4 model_view = frame.view * model;
+
+	// The model view matrix is rigid, so it transforms normals as well
+	vec3 N = normalize(mat3(model_view) * normal);
+	vec3 L = normalize(frame.light.xyz);
+	float diffuse = max(dot(N, L), 0.0);
+
+	color = vec4((0.2 + diffuse) * gear.color.rgb, 1.0);
+	gl_Position = frame.projection * model_view * vec4(position, 1.0);
+}
@@ -0,0 +1,595 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "swrast.h"
+#include "trace.h"
+
+/** The width and height of a screen tile in pixels */
+#define TILE_SIZE 64
+/** The number of pixels shaded at once */
+#define LANES 8
+/** The most vertices a triangle clipped against the near plane has */
+#define MAX_CLIPPED 4
+
+typedef float vfloat __attribute__((vector_size(LANES * sizeof(float))));
+typedef int32_t vint __attribute__((vector_size(LANES * sizeof(int32_t))));
+
+/**
+ * A transformed and lit vertex in clip coordinates.
+ */
+struct sw_clip_vertex {
+	float x, y, z, w;
+	/** The lit color */
+	float r, g, b;
+};
+
+/**
+ * A vertex in window coordinates.
+ */
+struct sw_vertex {
+	/** The window coordinates, y pointing down */
+	float x, y, z;
+	/** The lit color */
+	float r, g, b;
+};
+
+/**
+ * A triangle set up for rasterization.
+ *
+ * All attributes are stored as planes a * x + b * y + c over the window.
+ */
+struct sw_triangle {
+	/** The bounding box in pixels, the end is exclusive */
+	int x0, y0, x1, y1;
+	/** The edge functions, inside is where all three are >= 0 */
+	float edge[3][3];
+	/** The depth plane */
+	float z[3];
+	/** The color planes */
+	float color[3][3];
+};
+
+/**
+ * The list of triangles overlapping a tile.
+ */
+struct sw_bin {
+	uint32_t *tris;
+	int count, capacity;
+};
+
+struct swrast {
+	int nthreads;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t start, done;
+	/** Incremented for each frame handed to the workers */
+	unsigned generation;
+	/** The number of workers still rasterizing the current frame */
+	int busy;
+	bool quit;
+	/** The next tile to be picked up by a thread */
+	int next_tile;
+
+	/* The render target */
+	uint32_t *pixels;
+	int width, height, stride;
+	uint32_t clear;
+
+	struct sw_clip_vertex *verts;
+	int verts_capacity;
+
+	struct sw_triangle *tris;
+	int ntris, tris_capacity;
+
+	struct sw_bin *bins;
+	int tiles_x, tiles_y, bins_capacity;
+};
+
+/*
+ * Vectors are passed by pointer or through macros, since passing them by
+ * value changes the ABI depending on the instruction set.
+ */
+#define VSELECT(mask, a, b) (((mask) & (a)) | (~(mask) & (b)))
+
+static inline bool
+vany(const vint *m)
+{
+	int32_t r = 0;
+	int i;
+
+	for (i = 0; i < LANES; i++)
+		r |= (*m)[i];
+
+	return r != 0;
+}
+
+static void
+set_plane(float plane[3], const struct sw_triangle *t, float inv_area,
+	  float a, float b, float c)
+{
+	/* a, b and c are the values at the vertices opposite to edges 0, 1, 2 */
+	plane[0] = (a * t->edge[0][0] + b * t->edge[1][0] + c * t->edge[2][0]) * inv_area;
+	plane[1] = (a * t->edge[0][1] + b * t->edge[1][1] + c * t->edge[2][1]) * inv_area;
+	plane[2] = (a * t->edge[0][2] + b * t->edge[1][2] + c * t->edge[2][2]) * inv_area;
+}
+
+static void
+set_edge(float edge[3], const struct sw_vertex *a, const struct sw_vertex *b)
+{
+	edge[0] = a->y - b->y;
+	edge[1] = b->x - a->x;
+	edge[2] = -(edge[0] * a->x + edge[1] * a->y);
+}
+
+static bool
+bin_triangle(struct swrast *sw, int index)
+{
+	const struct sw_triangle *t = &sw->tris[index];
+	uint32_t *tris;
+	int tx, ty, capacity;
+
+	for (ty = t->y0 / TILE_SIZE; ty <= (t->y1 - 1) / TILE_SIZE; ty++) {
+		for (tx = t->x0 / TILE_SIZE; tx <= (t->x1 - 1) / TILE_SIZE; tx++) {
+			struct sw_bin *bin = &sw->bins[ty * sw->tiles_x + tx];
+
+			if (bin->count == bin->capacity) {
+				capacity = bin->capacity ? bin->capacity * 2 : 64;
+				tris = realloc(bin->tris, capacity * sizeof(*tris));
+				if (tris == NULL)
+					return false;
+				bin->tris = tris;
+				bin->capacity = capacity;
+			}
+			bin->tris[bin->count++] = index;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Sets up and bins a triangle.
+ *
+ * @return false if the triangle could not be allocated
+ */
+static bool
+setup_triangle(struct swrast *sw, const struct sw_vertex *v0,
+	       const struct sw_vertex *v1, const struct sw_vertex *v2)
+{
+	const struct sw_vertex *tmp;
+	struct sw_triangle *t, *tris;
+	float area, inv_area;
+	int capacity;
+
+	/*
+	 * With y pointing down, counter-clockwise front faces have a negative
+	 * area. Swap them into the positive orientation the edge functions use.
+	 */
+	area = (v1->x - v0->x) * (v2->y - v0->y) - (v2->x - v0->x) * (v1->y - v0->y);
+	if (area >= 0)
+		return true;
+	tmp = v1;
+	v1 = v2;
+	v2 = tmp;
+	area = -area;
+
+	if (sw->ntris == sw->tris_capacity) {
+		capacity = sw->tris_capacity ? sw->tris_capacity * 2 : 1024;
+		tris = realloc(sw->tris, capacity * sizeof(*tris));
+		if (tris == NULL)
+			return false;
+		sw->tris = tris;
+		sw->tris_capacity = capacity;
+	}
+	t = &sw->tris[sw->ntris];
+
+	t->x0 = fmaxf(floorf(fminf(fminf(v0->x, v1->x), v2->x)), 0);
+	t->y0 = fmaxf(floorf(fminf(fminf(v0->y, v1->y), v2->y)), 0);
+	t->x1 = fminf(ceilf(fmaxf(fmaxf(v0->x, v1->x), v2->x)), sw->width);
+	t->y1 = fminf(ceilf(fmaxf(fmaxf(v0->y, v1->y), v2->y)), sw->height);
+	if (t->x0 >= t->x1 || t->y0 >= t->y1)
+		return true;
+
+	/* Edge i is opposite to vertex i */
+	set_edge(t->edge[0], v1, v2);
+	set_edge(t->edge[1], v2, v0);
+	set_edge(t->edge[2], v0, v1);
+
+	inv_area = 1.0f / area;
+	set_plane(t->z, t, inv_area, v0->z, v1->z, v2->z);
+	set_plane(t->color[0], t, inv_area, v0->r, v1->r, v2->r);
+	set_plane(t->color[1], t, inv_area, v0->g, v1->g, v2->g);
+	set_plane(t->color[2], t, inv_area, v0->b, v1->b, v2->b);
+
+	return bin_triangle(sw, sw->ntris++);
+}
+
+/**
+ * Projects a vertex in clip coordinates to window coordinates.
+ */
+static void
+project_vertex(const struct swrast *sw, const struct sw_clip_vertex *c,
+	       struct sw_vertex *v)
+{
+	v->x = (c->x / c->w * 0.5f + 0.5f) * sw->width;
+	v->y = (0.5f - c->y / c->w * 0.5f) * sw->height;
+	v->z = c->z / c->w * 0.5f + 0.5f;
+	v->r = c->r;
+	v->g = c->g;
+	v->b = c->b;
+}
+
+/**
+ * Clips a triangle against the near plane, z = -w as in OpenGL, and sets
+ * up the remaining polygon as a fan, keeping the winding.
+ *
+ * @return false if a triangle could not be allocated
+ */
+static bool
+clip_triangle(struct swrast *sw, const struct sw_clip_vertex *v0,
+	      const struct sw_clip_vertex *v1, const struct sw_clip_vertex *v2)
+{
+	const struct sw_clip_vertex *in[3] = { v0, v1, v2 };
+	struct sw_clip_vertex clipped[MAX_CLIPPED];
+	struct sw_vertex out[MAX_CLIPPED];
+	float d[3], t;
+	int i, j, count = 0;
+
+	for (i = 0; i < 3; i++)
+		d[i] = in[i]->z + in[i]->w;
+
+	if (d[0] >= 0 && d[1] >= 0 && d[2] >= 0) {
+		for (i = 0; i < 3; i++)
+			project_vertex(sw, in[i], &out[i]);
+		return setup_triangle(sw, &out[0], &out[1], &out[2]);
+	}
+	if (d[0] < 0 && d[1] < 0 && d[2] < 0)
+		return true;
+
+	/* Sutherland-Hodgman against the single plane */
+	for (i = 0; i < 3; i++) {
+		const struct sw_clip_vertex *a = in[i], *b = in[(i + 1) % 3];
+
+		j = (i + 1) % 3;
+		if (d[i] >= 0)
+			clipped[count++] = *a;
+		if ((d[i] >= 0) != (d[j] >= 0)) {
+			struct sw_clip_vertex *c = &clipped[count++];
+
+			t = d[i] / (d[i] - d[j]);
+			c->x = a->x + (b->x - a->x) * t;
+			c->y = a->y + (b->y - a->y) * t;
+			c->z = a->z + (b->z - a->z) * t;
+			c->w = a->w + (b->w - a->w) * t;
+			c->r = a->r + (b->r - a->r) * t;
+			c->g = a->g + (b->g - a->g) * t;
+			c->b = a->b + (b->b - a->b) * t;
+		}
+	}
+
+	for (i = 0; i < count; i++)
+		project_vertex(sw, &clipped[i], &out[i]);
+	for (i = 2; i < count; i++)
+		if (!setup_triangle(sw, &out[0], &out[i - 1], &out[i]))
+			return false;
+
+	return true;
+}
+
+bool
+swrast_draw_strip(struct swrast *sw, const float *vertices, int count,
+		  const float mvp[16], const float normal_matrix[16],
+		  const float light[4], const float color[4])
+{
+	const float *m = mvp, *n = normal_matrix;
+	struct sw_clip_vertex *verts;
+	float lx, ly, lz, len;
+	bool ok = true;
+	int i;
+
+	if (count > sw->verts_capacity) {
+		verts = realloc(sw->verts, count * sizeof(*verts));
+		if (verts == NULL)
+			return false;
+		sw->verts = verts;
+		sw->verts_capacity = count;
+	}
+
+	len = sqrtf(light[0] * light[0] + light[1] * light[1] + light[2] * light[2]);
+	lx = light[0] / len;
+	ly = light[1] / len;
+	lz = light[2] / len;
+
+	/* The same transformation and lighting as the GLES vertex shader */
+	for (i = 0; i < count; i++) {
+		const float *p = vertices + i * 6, *nv = p + 3;
+		struct sw_clip_vertex *v = &sw->verts[i];
+		float nx, ny, nz, diffuse;
+
+		v->x = m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12];
+		v->y = m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13];
+		v->z = m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14];
+		v->w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+
+		nx = n[0] * nv[0] + n[4] * nv[1] + n[8] * nv[2] + n[12];
+		ny = n[1] * nv[0] + n[5] * nv[1] + n[9] * nv[2] + n[13];
+		nz = n[2] * nv[0] + n[6] * nv[1] + n[10] * nv[2] + n[14];
+		len = sqrtf(nx * nx + ny * ny + nz * nz);
+
+		diffuse = fmaxf((nx * lx + ny * ly + nz * lz) / len, 0.0f);
+		v->r = fminf((0.2f + diffuse) * color[0], 1.0f);
+		v->g = fminf((0.2f + diffuse) * color[1], 1.0f);
+		v->b = fminf((0.2f + diffuse) * color[2], 1.0f);
+	}
+
+	/* Every other triangle of a strip has its winding reversed */
+	for (i = 2; i < count && ok; i++) {
+		if (i & 1)
+			ok = clip_triangle(sw, &sw->verts[i - 1],
+					   &sw->verts[i - 2], &sw->verts[i]);
+		else
+			ok = clip_triangle(sw, &sw->verts[i - 2],
+					   &sw->verts[i - 1], &sw->verts[i]);
+	}
+
+	return ok;
+}
+
+static void
+rasterize_triangle(const struct sw_triangle *t, int tx, int ty,
+		   uint32_t *color, float *depth)
+{
+	const vfloat lanes = { 0, 1, 2, 3, 4, 5, 6, 7 };
+	const vint max = (vint) { 0 } + 255;
+	const vint alpha = (vint) { 0 } + (int32_t) 0xff000000;
+	int x0 = (t->x0 > tx ? t->x0 - tx : 0) & ~(LANES - 1);
+	int x1 = t->x1 - tx < TILE_SIZE ? t->x1 - tx : TILE_SIZE;
+	int y0 = t->y0 > ty ? t->y0 - ty : 0;
+	int y1 = t->y1 - ty < TILE_SIZE ? t->y1 - ty : TILE_SIZE;
+	int x, y;
+
+	for (y = y0; y < y1; y++) {
+		float py = ty + y + 0.5f;
+		float e0 = t->edge[0][1] * py + t->edge[0][2];
+		float e1 = t->edge[1][1] * py + t->edge[1][2];
+		float e2 = t->edge[2][1] * py + t->edge[2][2];
+		float z = t->z[1] * py + t->z[2];
+		float r = t->color[0][1] * py + t->color[0][2];
+		float g = t->color[1][1] * py + t->color[1][2];
+		float b = t->color[2][1] * py + t->color[2][2];
+
+		for (x = x0; x < x1; x += LANES) {
+			vfloat px = lanes + (float) (tx + x) + 0.5f;
+			vfloat *dst_depth = (vfloat *) &depth[y * TILE_SIZE + x];
+			vint *dst_color = (vint *) &color[y * TILE_SIZE + x];
+			vfloat vz, vr, vg, vb;
+			vint mask, pixel, ir, ig, ib;
+
+			mask = (t->edge[0][0] * px + e0 >= 0) &
+			       (t->edge[1][0] * px + e1 >= 0) &
+			       (t->edge[2][0] * px + e2 >= 0);
+			if (!vany(&mask))
+				continue;
+
+			vz = t->z[0] * px + z;
+			mask &= vz < *dst_depth;
+			if (!vany(&mask))
+				continue;
+
+			/*
+			 * The colors were clamped per vertex, so only rounding can
+			 * push them past 255.
+			 */
+			vr = (t->color[0][0] * px + r) * 255.0f + 0.5f;
+			vg = (t->color[1][0] * px + g) * 255.0f + 0.5f;
+			vb = (t->color[2][0] * px + b) * 255.0f + 0.5f;
+			ir = __builtin_convertvector(vr, vint);
+			ig = __builtin_convertvector(vg, vint);
+			ib = __builtin_convertvector(vb, vint);
+			ir = VSELECT(ir > 255, max, ir);
+			ig = VSELECT(ig > 255, max, ig);
+			ib = VSELECT(ib > 255, max, ib);
+			pixel = alpha | ir << 16 | ig << 8 | ib;
+
+			*dst_depth = (vfloat) VSELECT(mask, (vint) vz, (vint) *dst_depth);
+			*dst_color = VSELECT(mask, pixel, *dst_color);
+		}
+	}
+}
+
+static void
+rasterize_tiles(struct swrast *sw)
+{
+	uint32_t color[TILE_SIZE * TILE_SIZE] __attribute__((aligned(32)));
+	float depth[TILE_SIZE * TILE_SIZE] __attribute__((aligned(32)));
+	int ntiles = sw->tiles_x * sw->tiles_y;
+	int tile, i, y, tx, ty, w, h;
+	uint64_t t = trace_begin();
+
+	while ((tile = __atomic_fetch_add(&sw->next_tile, 1, __ATOMIC_RELAXED)) < ntiles) {
+		const struct sw_bin *bin = &sw->bins[tile];
+
+		tx = tile % sw->tiles_x * TILE_SIZE;
+		ty = tile / sw->tiles_x * TILE_SIZE;
+
+		for (i = 0; i < TILE_SIZE * TILE_SIZE; i++) {
+			color[i] = sw->clear;
+			depth[i] = 1.0f;
+		}
+
+		for (i = 0; i < bin->count; i++)
+			rasterize_triangle(&sw->tris[bin->tris[i]], tx, ty,
+					   color, depth);
+
+		w = sw->width - tx < TILE_SIZE ? sw->width - tx : TILE_SIZE;
+		h = sw->height - ty < TILE_SIZE ? sw->height - ty : TILE_SIZE;
+		for (y = 0; y < h; y++)
+			memcpy((char *) sw->pixels + (ty + y) * sw->stride + tx * 4,
+			       &color[y * TILE_SIZE], w * 4);
+	}
+
+	trace_end("rasterize tiles", t);
+}
+
+static void *
+worker_main(void *data)
+{
+	struct swrast *sw = data;
+	unsigned generation = 0;
+
+	trace_thread_name("swrast worker");
+
+	pthread_mutex_lock(&sw->lock);
+	for (;;) {
+		while (sw->generation == generation && !sw->quit)
+			pthread_cond_wait(&sw->start, &sw->lock);
+		if (sw->quit)
+			break;
+		generation = sw->generation;
+		pthread_mutex_unlock(&sw->lock);
+
+		rasterize_tiles(sw);
+
+		pthread_mutex_lock(&sw->lock);
+		if (--sw->busy == 0)
+			pthread_cond_signal(&sw->done);
+	}
+	pthread_mutex_unlock(&sw->lock);
+
+	return NULL;
+}
+
+struct swrast *
+swrast_create(int threads)
+{
+	struct swrast *sw;
+	int i;
+
+	sw = calloc(1, sizeof *sw);
+	if (sw == NULL)
+		return NULL;
+
+	sw->nthreads = threads > 0 ? threads : 1;
+	sw->threads = calloc(sw->nthreads, sizeof(*sw->threads));
+	if (sw->threads == NULL) {
+		free(sw);
+		return NULL;
+	}
+
+	pthread_mutex_init(&sw->lock, NULL);
+	pthread_cond_init(&sw->start, NULL);
+	pthread_cond_init(&sw->done, NULL);
+
+	/* The calling thread rasterizes too */
+	for (i = 0; i < sw->nthreads - 1; i++) {
+		if (pthread_create(&sw->threads[i], NULL, worker_main, sw) != 0) {
+			sw->nthreads = i + 1;
+			break;
+		}
+	}
+
+	return sw;
+}
+
+void
+swrast_destroy(struct swrast *sw)
+{
+	int i;
+
+	pthread_mutex_lock(&sw->lock);
+	sw->quit = true;
+	pthread_cond_broadcast(&sw->start);
+	pthread_mutex_unlock(&sw->lock);
+
+	for (i = 0; i < sw->nthreads - 1; i++)
+		pthread_join(sw->threads[i], NULL);
+
+	for (i = 0; i < sw->bins_capacity; i++)
+		free(sw->bins[i].tris);
+	free(sw->bins);
+	free(sw->tris);
+	free(sw->verts);
+	free(sw->threads);
+
+	pthread_cond_destroy(&sw->done);
+	pthread_cond_destroy(&sw->start);
+	pthread_mutex_destroy(&sw->lock);
+	free(sw);
+}
+
+bool
+swrast_begin(struct swrast *sw, uint32_t *pixels, int width, int height,
+	     int stride, uint32_t clear)
+{
+	struct sw_bin *bins;
+	int i, ntiles;
+
+	sw->pixels = pixels;
+	sw->width = width;
+	sw->height = height;
+	sw->stride = stride;
+	sw->clear = clear;
+	sw->ntris = 0;
+
+	sw->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	sw->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	ntiles = sw->tiles_x * sw->tiles_y;
+
+	if (ntiles > sw->bins_capacity) {
+		bins = realloc(sw->bins, ntiles * sizeof(*bins));
+		if (bins == NULL)
+			return false;
+		memset(bins + sw->bins_capacity, 0,
+		       (ntiles - sw->bins_capacity) * sizeof(*bins));
+		sw->bins = bins;
+		sw->bins_capacity = ntiles;
+	}
+
+	for (i = 0; i < ntiles; i++)
+		sw->bins[i].count = 0;
+
+	return true;
+}
+
+void
+swrast_end(struct swrast *sw)
+{
+	pthread_mutex_lock(&sw->lock);
+	sw->next_tile = 0;
+	sw->busy = sw->nthreads - 1;
+	sw->generation++;
+	pthread_cond_broadcast(&sw->start);
+	pthread_mutex_unlock(&sw->lock);
+
+	rasterize_tiles(sw);
+
+	pthread_mutex_lock(&sw->lock);
+	while (sw->busy > 0)
+		pthread_cond_wait(&sw->done, &sw->lock);
+	pthread_mutex_unlock(&sw->lock);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SWRAST_H
+#define SWRAST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A tile-based, multithreaded triangle rasterizer with a depth buffer.
+ *
+ * Triangles are transformed and lit per vertex on the calling thread,
+ * binned into screen tiles, and the tiles are then shaded in parallel
+ * several pixels at a time using vector extensions.
+ */
+struct swrast;
+
+/**
+ * Creates a rasterizer.
+ *
+ * @param threads the number of threads rasterizing tiles, including the
+ * calling thread
+ *
+ * @return the rasterizer or NULL on failure
+ */
+struct swrast *
+swrast_create(int threads);
+
+void
+swrast_destroy(struct swrast *sw);
+
+/**
+ * Starts a frame.
+ *
+ * @param pixels the XRGB8888/ARGB8888 pixels to render to
+ * @param width the width of the target in pixels
+ * @param height the height of the target in pixels
+ * @param stride the distance between rows in bytes
+ * @param clear the color the target is cleared to
+ *
+ * @return false if the tile bins could not be allocated
+ */
+bool
+swrast_begin(struct swrast *sw, uint32_t *pixels, int width, int height,
+	     int stride, uint32_t clear);
+
+/**
+ * Queues a triangle strip.
+ *
+ * Each vertex consists of a position followed by a normal. Triangles are
+ * clipped against the near plane as in OpenGL. Back faces, following the
+ * OpenGL counter-clockwise convention, are culled.
+ *
+ * @param vertices the vertices, 6 floats each
+ * @param count the number of vertices
+ * @param mvp the column-major model view projection matrix
+ * @param normal_matrix the column-major normal matrix
+ * @param light the direction of the directional light in eye coordinates
+ * @param color the material color
+ *
+ * @return false if the triangles could not be allocated, in which case
+ * the frame is incomplete
+ */
+bool
+swrast_draw_strip(struct swrast *sw, const float *vertices, int count,
+		  const float mvp[16], const float normal_matrix[16],
+		  const float light[4], const float color[4]);
+
+/**
+ * Rasterizes the queued triangles into the target and ends the frame.
+ */
+void
+swrast_end(struct swrast *sw);
+
+#endif
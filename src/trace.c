@@ -0,0 +1,194 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+struct trace_event {
+	const char *name;
+	uint64_t start, end;
+};
+
+/**
+ * The events of a thread. Once full, the oldest events are overwritten.
+ */
+struct trace_ring {
+	struct trace_ring *next;
+	pid_t tid;
+	const char *name;
+	struct trace_event *events;
+	/** The total number of events recorded */
+	uint64_t count;
+};
+
+bool trace_enabled;
+
+static const char *trace_path;
+static int trace_capacity;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *trace_rings;
+static __thread struct trace_ring *thread_ring;
+
+uint64_t
+trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Returns the ring of the calling thread, allocating it on first use.
+ */
+static struct trace_ring *
+get_ring(void)
+{
+	struct trace_ring *ring = thread_ring;
+
+	if (ring)
+		return ring;
+
+	ring = calloc(1, sizeof *ring);
+	if (!ring)
+		return NULL;
+	ring->events = calloc(trace_capacity, sizeof(*ring->events));
+	if (!ring->events) {
+		free(ring);
+		return NULL;
+	}
+	ring->tid = gettid();
+
+	pthread_mutex_lock(&trace_lock);
+	ring->next = trace_rings;
+	trace_rings = ring;
+	pthread_mutex_unlock(&trace_lock);
+
+	thread_ring = ring;
+	return ring;
+}
+
+bool
+trace_init(const char *path, int events)
+{
+	trace_path = path;
+	trace_capacity = events > 0 ? events : 1;
+	trace_enabled = true;
+
+	/* Preallocate the ring of the main thread */
+	if (!get_ring()) {
+		trace_enabled = false;
+		return false;
+	}
+
+	return true;
+}
+
+void
+trace_thread_name(const char *name)
+{
+	struct trace_ring *ring;
+
+	if (!trace_enabled)
+		return;
+
+	ring = get_ring();
+	if (ring)
+		ring->name = name;
+}
+
+void
+trace_record(const char *name, uint64_t start, uint64_t end)
+{
+	struct trace_ring *ring = get_ring();
+	struct trace_event *event;
+
+	if (!ring)
+		return;
+
+	event = &ring->events[ring->count++ % trace_capacity];
+	event->name = name;
+	event->start = start;
+	event->end = end;
+}
+
+void
+trace_finish(void)
+{
+	struct trace_ring *ring, *next;
+	struct trace_event *event;
+	uint64_t first, i;
+	bool comma = false;
+	pid_t pid = getpid();
+	FILE *f;
+
+	if (!trace_enabled)
+		return;
+	trace_enabled = false;
+
+	f = fopen(trace_path, "w");
+	if (!f)
+		perror(trace_path);
+	else
+		fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (ring = trace_rings; ring; ring = next) {
+		next = ring->next;
+
+		if (f && ring->name) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				comma ? ",\n" : "", pid, ring->tid, ring->name);
+			comma = true;
+		}
+
+		first = ring->count > (uint64_t) trace_capacity ?
+			ring->count - trace_capacity : 0;
+		for (i = first; f && i < ring->count; i++) {
+			event = &ring->events[i % trace_capacity];
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+				"\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				comma ? ",\n" : "", event->name, pid, ring->tid,
+				event->start / 1000.0,
+				(event->end - event->start) / 1000.0);
+			comma = true;
+		}
+
+		free(ring->events);
+		free(ring);
+	}
+	trace_rings = NULL;
+	thread_ring = NULL;
+
+	if (f) {
+		fprintf(f, "\n]}\n");
+		fclose(f);
+	}
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Span tracing to Chrome trace-event JSON, viewable in chrome://tracing
+ * or the Perfetto UI.
+ *
+ * Each thread records complete events into its own preallocated ring,
+ * keeping the most recent ones, so recording is lock free and cheap. The
+ * rings are written out by trace_finish().
+ *
+ * Usage:
+ *
+ *	uint64_t t = trace_begin();
+ *	...
+ *	trace_end("phase", t);
+ *
+ * Span names must be string literals or otherwise outlive the trace.
+ */
+
+extern bool trace_enabled;
+
+/**
+ * Starts tracing.
+ *
+ * @param path the file written by trace_finish()
+ * @param events the capacity of the ring of each thread
+ *
+ * @return false on failure
+ */
+bool
+trace_init(const char *path, int events);
+
+/**
+ * Names the calling thread in the trace.
+ */
+void
+trace_thread_name(const char *name);
+
+/**
+ * Writes the trace file and stops tracing.
+ *
+ * Must be called after all traced threads have exited.
+ */
+void
+trace_finish(void);
+
+uint64_t
+trace_now(void);
+
+void
+trace_record(const char *name, uint64_t start, uint64_t end);
+
+/**
+ * @return the start time of a span, 0 if tracing is disabled
+ */
+static inline uint64_t
+trace_begin(void)
+{
+	return trace_enabled ? trace_now() : 0;
+}
+
+/**
+ * Records a span started with trace_begin().
+ */
+static inline void
+trace_end(const char *name, uint64_t start)
+{
+	if (start)
+		trace_record(name, start, trace_now());
+}
+
+#endif
@@ -0,0 +1,1240 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define VK_USE_PLATFORM_WAYLAND_KHR
+#include <vulkan/vulkan.h>
+
+#include "vkrender.h"
+#include "gears.vert.h"
+#include "gears.frag.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+/** Always supported as a depth attachment */
+#define DEPTH_FORMAT VK_FORMAT_D16_UNORM
+
+/**
+ * The uniforms updated every frame, laid out following std140.
+ */
+struct vk_uniforms {
+	float projection[16];
+	float view[16];
+	float light[4];
+	float angle[4];
+};
+
+/**
+ * The push constants of a gear, recorded once into the command buffers.
+ */
+struct vk_push {
+	float color[4];
+	float placement[4];
+};
+
+/**
+ * The resources belonging to a swapchain image.
+ *
+ * Each image has its own uniform buffer, so a recorded command buffer
+ * always reads the uniforms of the frame it renders.
+ */
+struct vk_image {
+	VkImage image;
+	VkImageView view;
+	VkFramebuffer framebuffer;
+	VkCommandBuffer cmd;
+	VkBuffer ubo;
+	VkDeviceMemory ubo_memory;
+	void *uniforms;
+	VkDescriptorSet set;
+	VkSemaphore render_finished;
+	/** The fence of the frame last rendering to the image */
+	VkFence fence;
+};
+
+/**
+ * The synchronization of a frame in flight.
+ */
+struct vk_frame {
+	VkSemaphore image_available;
+	VkFence fence;
+};
+
+struct vk_mesh {
+	uint32_t first, count;
+};
+
+struct vkrender {
+	VkInstance instance;
+	VkSurfaceKHR surface;
+	VkPhysicalDevice physical;
+	VkPhysicalDeviceProperties properties;
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	VkDevice device;
+	uint32_t queue_family;
+	VkQueue queue;
+
+	VkSurfaceFormatKHR format;
+	VkPresentModeKHR present_mode;
+	VkCompositeAlphaFlagBitsKHR composite_alpha;
+	VkSwapchainKHR swapchain;
+	VkExtent2D extent;
+	uint32_t nimages;
+	struct vk_image *images;
+
+	VkImage depth;
+	VkDeviceMemory depth_memory;
+	VkImageView depth_view;
+
+	VkRenderPass render_pass;
+	VkDescriptorSetLayout set_layout;
+	VkPipelineLayout pipeline_layout;
+	VkPipeline pipeline;
+	VkCommandPool command_pool;
+	VkDescriptorPool descriptor_pool;
+
+	VkBuffer vertex_buffer;
+	VkDeviceMemory vertex_memory;
+	struct vk_mesh *meshes;
+	int nmeshes;
+	struct vkrender_gear *gears;
+	int ngears;
+
+	struct vk_frame *frames;
+	int nframes, frame;
+
+	bool vsync, opaque, resized;
+	int width, height;
+};
+
+static bool
+check(VkResult result, const char *what)
+{
+	if (result == VK_SUCCESS)
+		return true;
+
+	fprintf(stderr, "%s failed: %d\n", what, result);
+	return false;
+}
+
+/**
+ * Reports a failed allocation of @count elements the way check() reports a
+ * failed Vulkan call. An empty allocation may legitimately return NULL.
+ */
+static bool
+check_alloc(const void *ptr, size_t count, const char *what)
+{
+	if (ptr != NULL || count == 0)
+		return true;
+
+	fprintf(stderr, "%s: out of memory\n", what);
+	return false;
+}
+
+static int
+find_memory_type(struct vkrender *vk, uint32_t type_bits,
+		 VkMemoryPropertyFlags flags)
+{
+	const VkPhysicalDeviceMemoryProperties *props = &vk->memory_properties;
+	uint32_t i;
+
+	for (i = 0; i < props->memoryTypeCount; i++) {
+		if ((type_bits & (1u << i)) &&
+		    (props->memoryTypes[i].propertyFlags & flags) == flags)
+			return i;
+	}
+
+	return -1;
+}
+
+static bool
+allocate_memory(struct vkrender *vk, const VkMemoryRequirements *req,
+		VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags required,
+		VkDeviceMemory *memory)
+{
+	VkMemoryAllocateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = req->size,
+	};
+	int type;
+
+	type = find_memory_type(vk, req->memoryTypeBits, preferred | required);
+	if (type < 0)
+		type = find_memory_type(vk, req->memoryTypeBits, required);
+	if (type < 0) {
+		fprintf(stderr, "no suitable Vulkan memory type\n");
+		return false;
+	}
+
+	info.memoryTypeIndex = type;
+	return check(vkAllocateMemory(vk->device, &info, NULL, memory),
+		     "vkAllocateMemory");
+}
+
+/**
+ * Creates a host visible buffer and maps it.
+ *
+ * Device local memory is preferred where it is also host visible, as on
+ * integrated GPUs and software rasterizers.
+ */
+static bool
+create_mapped_buffer(struct vkrender *vk, VkDeviceSize size,
+		     VkBufferUsageFlags usage, VkBuffer *buffer,
+		     VkDeviceMemory *memory, void **map)
+{
+	VkBufferCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VkMemoryRequirements req;
+
+	if (!check(vkCreateBuffer(vk->device, &info, NULL, buffer),
+		   "vkCreateBuffer"))
+		return false;
+
+	vkGetBufferMemoryRequirements(vk->device, *buffer, &req);
+	if (!allocate_memory(vk, &req, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, memory))
+		return false;
+
+	if (!check(vkBindBufferMemory(vk->device, *buffer, *memory, 0),
+		   "vkBindBufferMemory"))
+		return false;
+
+	return check(vkMapMemory(vk->device, *memory, 0, VK_WHOLE_SIZE, 0, map),
+		     "vkMapMemory");
+}
+
+static bool
+create_instance(struct vkrender *vk, struct wl_display *display,
+		struct wl_surface *surface)
+{
+	static const char *extensions[] = {
+		VK_KHR_SURFACE_EXTENSION_NAME,
+		VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME,
+	};
+	VkApplicationInfo app = {
+		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+		.pApplicationName = "wlgears",
+		.apiVersion = VK_API_VERSION_1_0,
+	};
+	VkInstanceCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pApplicationInfo = &app,
+		.enabledExtensionCount = ARRAY_LENGTH(extensions),
+		.ppEnabledExtensionNames = extensions,
+	};
+	VkWaylandSurfaceCreateInfoKHR surface_info = {
+		.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR,
+		.display = display,
+		.surface = surface,
+	};
+
+	if (!check(vkCreateInstance(&info, NULL, &vk->instance),
+		   "vkCreateInstance"))
+		return false;
+
+	return check(vkCreateWaylandSurfaceKHR(vk->instance, &surface_info,
+					       NULL, &vk->surface),
+		     "vkCreateWaylandSurfaceKHR");
+}
+
+/**
+ * Picks the first physical device with a queue family that can both render
+ * and present to the surface.
+ *
+ * The device can be restricted with the loader's VK_DRIVER_FILES, e.g. to
+ * run on lavapipe.
+ */
+static bool
+pick_device(struct vkrender *vk)
+{
+	VkPhysicalDevice *devices;
+	VkQueueFamilyProperties *families;
+	uint32_t ndevices = 0, nfamilies, i, j;
+	VkBool32 present;
+
+	vkEnumeratePhysicalDevices(vk->instance, &ndevices, NULL);
+	devices = calloc(ndevices, sizeof(*devices));
+	if (!check_alloc(devices, ndevices, "physical devices"))
+		return false;
+	vkEnumeratePhysicalDevices(vk->instance, &ndevices, devices);
+
+	for (i = 0; i < ndevices && vk->physical == VK_NULL_HANDLE; i++) {
+		vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &nfamilies,
+							 NULL);
+		families = calloc(nfamilies, sizeof(*families));
+		if (!check_alloc(families, nfamilies, "queue families")) {
+			free(devices);
+			return false;
+		}
+		vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &nfamilies,
+							 families);
+
+		for (j = 0; j < nfamilies; j++) {
+			if (!(families[j].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+				continue;
+
+			present = VK_FALSE;
+			vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], j,
+							     vk->surface,
+							     &present);
+			if (present) {
+				vk->physical = devices[i];
+				vk->queue_family = j;
+				break;
+			}
+		}
+
+		free(families);
+	}
+
+	free(devices);
+
+	if (vk->physical == VK_NULL_HANDLE) {
+		fprintf(stderr, "no Vulkan device can present to the surface\n");
+		return false;
+	}
+
+	vkGetPhysicalDeviceProperties(vk->physical, &vk->properties);
+	vkGetPhysicalDeviceMemoryProperties(vk->physical,
+					    &vk->memory_properties);
+	return true;
+}
+
+static bool
+create_device(struct vkrender *vk)
+{
+	static const char *extensions[] = {
+		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+	};
+	float priority = 1.0f;
+	VkDeviceQueueCreateInfo queue = {
+		.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+		.queueFamilyIndex = vk->queue_family,
+		.queueCount = 1,
+		.pQueuePriorities = &priority,
+	};
+	VkDeviceCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.queueCreateInfoCount = 1,
+		.pQueueCreateInfos = &queue,
+		.enabledExtensionCount = ARRAY_LENGTH(extensions),
+		.ppEnabledExtensionNames = extensions,
+	};
+	VkCommandPoolCreateInfo pool = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = vk->queue_family,
+	};
+
+	if (!check(vkCreateDevice(vk->physical, &info, NULL, &vk->device),
+		   "vkCreateDevice"))
+		return false;
+
+	vkGetDeviceQueue(vk->device, vk->queue_family, 0, &vk->queue);
+
+	return check(vkCreateCommandPool(vk->device, &pool, NULL,
+					 &vk->command_pool),
+		     "vkCreateCommandPool");
+}
+
+/**
+ * Chooses the surface format, present mode and alpha mode.
+ */
+static bool
+choose_surface_config(struct vkrender *vk)
+{
+	VkSurfaceFormatKHR *formats;
+	VkPresentModeKHR *modes;
+	VkSurfaceCapabilitiesKHR caps;
+	uint32_t count, i;
+	bool mailbox = false, immediate = false;
+
+	vkGetPhysicalDeviceSurfaceFormatsKHR(vk->physical, vk->surface,
+					     &count, NULL);
+	formats = calloc(count, sizeof(*formats));
+	if (!check_alloc(formats, count, "surface formats"))
+		return false;
+	if (count == 0) {
+		fprintf(stderr, "the surface has no formats\n");
+		free(formats);
+		return false;
+	}
+	vkGetPhysicalDeviceSurfaceFormatsKHR(vk->physical, vk->surface,
+					     &count, formats);
+	vk->format = formats[0];
+	for (i = 0; i < count; i++) {
+		if (formats[i].format == VK_FORMAT_B8G8R8A8_UNORM) {
+			vk->format = formats[i];
+			break;
+		}
+	}
+	free(formats);
+
+	vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physical, vk->surface,
+						  &count, NULL);
+	modes = calloc(count, sizeof(*modes));
+	if (!check_alloc(modes, count, "present modes"))
+		return false;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(vk->physical, vk->surface,
+						  &count, modes);
+	for (i = 0; i < count; i++) {
+		if (modes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+			mailbox = true;
+		else if (modes[i] == VK_PRESENT_MODE_IMMEDIATE_KHR)
+			immediate = true;
+	}
+	free(modes);
+
+	/* FIFO is the only mode that is always supported */
+	vk->present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	if (!vk->vsync && mailbox)
+		vk->present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+	else if (!vk->vsync && immediate)
+		vk->present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk->physical, vk->surface,
+						  &caps);
+	if (!vk->opaque && (caps.supportedCompositeAlpha &
+			    VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR))
+		vk->composite_alpha = VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR;
+	else if (caps.supportedCompositeAlpha &
+		 VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR)
+		vk->composite_alpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	else
+		vk->composite_alpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+	return true;
+}
+
+static bool
+create_render_pass(struct vkrender *vk)
+{
+	VkAttachmentDescription attachments[] = {
+		{
+			.format = vk->format.format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		},
+		{
+			.format = DEPTH_FORMAT,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		},
+	};
+	VkAttachmentReference color = {
+		0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	};
+	VkAttachmentReference depth = {
+		1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	};
+	VkSubpassDescription subpass = {
+		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &color,
+		.pDepthStencilAttachment = &depth,
+	};
+	/*
+	 * The depth buffer is shared by all frames in flight, so the previous
+	 * frame's depth writes have to finish before this frame clears it.
+	 */
+	VkSubpassDependency dependency = {
+		.srcSubpass = VK_SUBPASS_EXTERNAL,
+		.dstSubpass = 0,
+		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+				VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+		.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+				 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+				 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+	};
+	VkRenderPassCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = ARRAY_LENGTH(attachments),
+		.pAttachments = attachments,
+		.subpassCount = 1,
+		.pSubpasses = &subpass,
+		.dependencyCount = 1,
+		.pDependencies = &dependency,
+	};
+
+	return check(vkCreateRenderPass(vk->device, &info, NULL,
+					&vk->render_pass),
+		     "vkCreateRenderPass");
+}
+
+static VkShaderModule
+create_shader_module(struct vkrender *vk, const uint32_t *code, size_t size)
+{
+	VkShaderModuleCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = size,
+		.pCode = code,
+	};
+	VkShaderModule module = VK_NULL_HANDLE;
+
+	check(vkCreateShaderModule(vk->device, &info, NULL, &module),
+	      "vkCreateShaderModule");
+	return module;
+}
+
+/**
+ * Creates the pipeline. The viewport and scissor are dynamic, so the
+ * pipeline survives swapchain recreation.
+ */
+static bool
+create_pipeline(struct vkrender *vk)
+{
+	VkDescriptorSetLayoutBinding binding = {
+		.binding = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+	};
+	VkDescriptorSetLayoutCreateInfo set_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 1,
+		.pBindings = &binding,
+	};
+	VkPushConstantRange push = {
+		VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(struct vk_push)
+	};
+	VkPipelineLayoutCreateInfo layout_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &vk->set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &push,
+	};
+	VkShaderModule vert, frag;
+	VkPipelineShaderStageCreateInfo stages[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_VERTEX_BIT,
+			.pName = "main",
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+			.pName = "main",
+		},
+	};
+	VkVertexInputBindingDescription vertex_binding = {
+		0, 6 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX
+	};
+	VkVertexInputAttributeDescription attributes[] = {
+		{ 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 },
+		{ 1, 0, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float) },
+	};
+	VkPipelineVertexInputStateCreateInfo vertex_input = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &vertex_binding,
+		.vertexAttributeDescriptionCount = ARRAY_LENGTH(attributes),
+		.pVertexAttributeDescriptions = attributes,
+	};
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+		.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP,
+	};
+	VkPipelineViewportStateCreateInfo viewport = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+		.viewportCount = 1,
+		.scissorCount = 1,
+	};
+	/*
+	 * The projection flips y, which keeps the OpenGL winding order of the
+	 * meshes counter-clockwise in framebuffer coordinates.
+	 */
+	VkPipelineRasterizationStateCreateInfo rasterization = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+		.polygonMode = VK_POLYGON_MODE_FILL,
+		.cullMode = VK_CULL_MODE_BACK_BIT,
+		.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+		.lineWidth = 1.0f,
+	};
+	VkPipelineMultisampleStateCreateInfo multisample = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+		.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+	};
+	VkPipelineDepthStencilStateCreateInfo depth = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.depthTestEnable = VK_TRUE,
+		.depthWriteEnable = VK_TRUE,
+		.depthCompareOp = VK_COMPARE_OP_LESS,
+	};
+	VkPipelineColorBlendAttachmentState blend_attachment = {
+		.colorWriteMask = VK_COLOR_COMPONENT_R_BIT |
+				  VK_COLOR_COMPONENT_G_BIT |
+				  VK_COLOR_COMPONENT_B_BIT |
+				  VK_COLOR_COMPONENT_A_BIT,
+	};
+	VkPipelineColorBlendStateCreateInfo blend = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+		.attachmentCount = 1,
+		.pAttachments = &blend_attachment,
+	};
+	VkDynamicState dynamic_states[] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR,
+	};
+	VkPipelineDynamicStateCreateInfo dynamic = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+		.dynamicStateCount = ARRAY_LENGTH(dynamic_states),
+		.pDynamicStates = dynamic_states,
+	};
+	VkGraphicsPipelineCreateInfo info = {
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = ARRAY_LENGTH(stages),
+		.pStages = stages,
+		.pVertexInputState = &vertex_input,
+		.pInputAssemblyState = &input_assembly,
+		.pViewportState = &viewport,
+		.pRasterizationState = &rasterization,
+		.pMultisampleState = &multisample,
+		.pDepthStencilState = &depth,
+		.pColorBlendState = &blend,
+		.pDynamicState = &dynamic,
+		.renderPass = vk->render_pass,
+		.subpass = 0,
+	};
+	bool ok;
+
+	if (!check(vkCreateDescriptorSetLayout(vk->device, &set_info, NULL,
+					       &vk->set_layout),
+		   "vkCreateDescriptorSetLayout"))
+		return false;
+
+	if (!check(vkCreatePipelineLayout(vk->device, &layout_info, NULL,
+					  &vk->pipeline_layout),
+		   "vkCreatePipelineLayout"))
+		return false;
+
+	vert = create_shader_module(vk, gears_vert_spv, sizeof(gears_vert_spv));
+	frag = create_shader_module(vk, gears_frag_spv, sizeof(gears_frag_spv));
+	stages[0].module = vert;
+	stages[1].module = frag;
+	info.layout = vk->pipeline_layout;
+
+	ok = vert != VK_NULL_HANDLE && frag != VK_NULL_HANDLE &&
+	     check(vkCreateGraphicsPipelines(vk->device, VK_NULL_HANDLE, 1,
+					     &info, NULL, &vk->pipeline),
+		   "vkCreateGraphicsPipelines");
+
+	vkDestroyShaderModule(vk->device, vert, NULL);
+	vkDestroyShaderModule(vk->device, frag, NULL);
+	return ok;
+}
+
+static bool
+create_frames(struct vkrender *vk)
+{
+	VkSemaphoreCreateInfo semaphore = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+	VkFenceCreateInfo fence = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT,
+	};
+	int i;
+
+	vk->frames = calloc(vk->nframes, sizeof(*vk->frames));
+	if (!check_alloc(vk->frames, vk->nframes, "frames"))
+		return false;
+	for (i = 0; i < vk->nframes; i++) {
+		if (!check(vkCreateSemaphore(vk->device, &semaphore, NULL,
+					     &vk->frames[i].image_available),
+			   "vkCreateSemaphore") ||
+		    !check(vkCreateFence(vk->device, &fence, NULL,
+					 &vk->frames[i].fence),
+			   "vkCreateFence"))
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+create_depth(struct vkrender *vk)
+{
+	VkImageCreateInfo image = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = DEPTH_FORMAT,
+		.extent = { vk->extent.width, vk->extent.height, 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+	VkImageViewCreateInfo view = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = DEPTH_FORMAT,
+		.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 },
+	};
+	VkMemoryRequirements req;
+
+	if (!check(vkCreateImage(vk->device, &image, NULL, &vk->depth),
+		   "vkCreateImage"))
+		return false;
+
+	vkGetImageMemoryRequirements(vk->device, vk->depth, &req);
+	if (!allocate_memory(vk, &req, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			     &vk->depth_memory) ||
+	    !check(vkBindImageMemory(vk->device, vk->depth, vk->depth_memory, 0),
+		   "vkBindImageMemory"))
+		return false;
+
+	view.image = vk->depth;
+	return check(vkCreateImageView(vk->device, &view, NULL,
+				       &vk->depth_view),
+		     "vkCreateImageView");
+}
+
+/**
+ * Records the draws of the whole scene for a swapchain image.
+ */
+static bool
+record_commands(struct vkrender *vk, struct vk_image *image)
+{
+	VkCommandBufferBeginInfo begin = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	};
+	VkClearValue clear[2] = {
+		{ .color = { .float32 = { 0.0f, 0.0f, 0.0f, 0.0f } } },
+		{ .depthStencil = { 1.0f, 0 } },
+	};
+	VkRenderPassBeginInfo pass = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = vk->render_pass,
+		.framebuffer = image->framebuffer,
+		.renderArea = { { 0, 0 }, vk->extent },
+		.clearValueCount = ARRAY_LENGTH(clear),
+		.pClearValues = clear,
+	};
+	VkViewport viewport = {
+		0.0f, 0.0f, vk->extent.width, vk->extent.height, 0.0f, 1.0f
+	};
+	VkRect2D scissor = { { 0, 0 }, vk->extent };
+	VkDeviceSize offset = 0;
+	VkCommandBuffer cmd = image->cmd;
+	struct vk_push push;
+	const struct vkrender_gear *gear;
+	const struct vk_mesh *mesh;
+	int i;
+
+	if (!check(vkBeginCommandBuffer(cmd, &begin), "vkBeginCommandBuffer"))
+		return false;
+
+	vkCmdBeginRenderPass(cmd, &pass, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, vk->pipeline);
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				vk->pipeline_layout, 0, 1, &image->set, 0, NULL);
+	vkCmdBindVertexBuffers(cmd, 0, 1, &vk->vertex_buffer, &offset);
+
+	for (i = 0; i < vk->ngears; i++) {
+		gear = &vk->gears[i];
+		mesh = &vk->meshes[gear->mesh];
+
+		memcpy(push.color, gear->color, sizeof(push.color));
+		push.placement[0] = gear->x;
+		push.placement[1] = gear->y;
+		push.placement[2] = gear->ratio;
+		push.placement[3] = gear->phase;
+
+		vkCmdPushConstants(cmd, vk->pipeline_layout,
+				   VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push),
+				   &push);
+		vkCmdDraw(cmd, mesh->count, 1, mesh->first, 0);
+	}
+
+	vkCmdEndRenderPass(cmd);
+	return check(vkEndCommandBuffer(cmd), "vkEndCommandBuffer");
+}
+
+/**
+ * Destroys everything depending on the swapchain but the swapchain itself.
+ */
+static void
+destroy_swapchain_resources(struct vkrender *vk)
+{
+	struct vk_image *image;
+	uint32_t i;
+
+	for (i = 0; i < vk->nimages; i++) {
+		image = &vk->images[i];
+		vkDestroyFramebuffer(vk->device, image->framebuffer, NULL);
+		vkDestroyImageView(vk->device, image->view, NULL);
+		vkDestroyBuffer(vk->device, image->ubo, NULL);
+		vkFreeMemory(vk->device, image->ubo_memory, NULL);
+		vkDestroySemaphore(vk->device, image->render_finished, NULL);
+		if (image->cmd != VK_NULL_HANDLE)
+			vkFreeCommandBuffers(vk->device, vk->command_pool, 1,
+					     &image->cmd);
+	}
+
+	free(vk->images);
+	vk->images = NULL;
+	vk->nimages = 0;
+
+	vkDestroyDescriptorPool(vk->device, vk->descriptor_pool, NULL);
+	vk->descriptor_pool = VK_NULL_HANDLE;
+
+	vkDestroyImageView(vk->device, vk->depth_view, NULL);
+	vkDestroyImage(vk->device, vk->depth, NULL);
+	vkFreeMemory(vk->device, vk->depth_memory, NULL);
+	vk->depth_view = VK_NULL_HANDLE;
+	vk->depth = VK_NULL_HANDLE;
+	vk->depth_memory = VK_NULL_HANDLE;
+}
+
+static bool
+create_image(struct vkrender *vk, struct vk_image *image)
+{
+	VkImageViewCreateInfo view = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = image->image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = vk->format.format,
+		.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+	};
+	VkImageView attachments[2];
+	VkFramebufferCreateInfo framebuffer = {
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = vk->render_pass,
+		.attachmentCount = ARRAY_LENGTH(attachments),
+		.pAttachments = attachments,
+		.width = vk->extent.width,
+		.height = vk->extent.height,
+		.layers = 1,
+	};
+	VkDescriptorSetAllocateInfo set = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = vk->descriptor_pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &vk->set_layout,
+	};
+	VkDescriptorBufferInfo buffer = {
+		.offset = 0,
+		.range = sizeof(struct vk_uniforms),
+	};
+	VkWriteDescriptorSet write = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstBinding = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		.pBufferInfo = &buffer,
+	};
+	VkCommandBufferAllocateInfo cmd = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = vk->command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	VkSemaphoreCreateInfo semaphore = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+	};
+
+	if (!check(vkCreateImageView(vk->device, &view, NULL, &image->view),
+		   "vkCreateImageView"))
+		return false;
+
+	attachments[0] = image->view;
+	attachments[1] = vk->depth_view;
+	if (!check(vkCreateFramebuffer(vk->device, &framebuffer, NULL,
+				       &image->framebuffer),
+		   "vkCreateFramebuffer"))
+		return false;
+
+	if (!create_mapped_buffer(vk, sizeof(struct vk_uniforms),
+				  VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+				  &image->ubo, &image->ubo_memory,
+				  &image->uniforms))
+		return false;
+
+	if (!check(vkAllocateDescriptorSets(vk->device, &set, &image->set),
+		   "vkAllocateDescriptorSets"))
+		return false;
+
+	buffer.buffer = image->ubo;
+	write.dstSet = image->set;
+	vkUpdateDescriptorSets(vk->device, 1, &write, 0, NULL);
+
+	if (!check(vkCreateSemaphore(vk->device, &semaphore, NULL,
+				     &image->render_finished),
+		   "vkCreateSemaphore"))
+		return false;
+
+	if (!check(vkAllocateCommandBuffers(vk->device, &cmd, &image->cmd),
+		   "vkAllocateCommandBuffers"))
+		return false;
+
+	return record_commands(vk, image);
+}
+
+/**
+ * (Re)creates the swapchain for the current size and records the command
+ * buffers of its images.
+ */
+static bool
+create_swapchain(struct vkrender *vk)
+{
+	VkSurfaceCapabilitiesKHR caps;
+	VkSwapchainCreateInfoKHR info = {
+		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+		.surface = vk->surface,
+		.imageFormat = vk->format.format,
+		.imageColorSpace = vk->format.colorSpace,
+		.imageArrayLayers = 1,
+		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
+		.compositeAlpha = vk->composite_alpha,
+		.presentMode = vk->present_mode,
+		.clipped = VK_TRUE,
+		.oldSwapchain = vk->swapchain,
+	};
+	VkDescriptorPoolSize pool_size = {
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0
+	};
+	VkDescriptorPoolCreateInfo pool = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.poolSizeCount = 1,
+		.pPoolSizes = &pool_size,
+	};
+	VkImage *images;
+	uint32_t count, i;
+
+	vkDeviceWaitIdle(vk->device);
+	destroy_swapchain_resources(vk);
+
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk->physical, vk->surface,
+						  &caps);
+
+	/* Wayland leaves the extent up to the client */
+	if (caps.currentExtent.width == UINT32_MAX) {
+		vk->extent.width = vk->width;
+		vk->extent.height = vk->height;
+		if (vk->extent.width < caps.minImageExtent.width)
+			vk->extent.width = caps.minImageExtent.width;
+		if (vk->extent.height < caps.minImageExtent.height)
+			vk->extent.height = caps.minImageExtent.height;
+	} else {
+		vk->extent = caps.currentExtent;
+	}
+
+	count = caps.minImageCount + 1;
+	if (caps.maxImageCount > 0 && count > caps.maxImageCount)
+		count = caps.maxImageCount;
+
+	info.minImageCount = count;
+	info.imageExtent = vk->extent;
+
+	if (!check(vkCreateSwapchainKHR(vk->device, &info, NULL,
+					&vk->swapchain),
+		   "vkCreateSwapchainKHR"))
+		return false;
+
+	vkDestroySwapchainKHR(vk->device, info.oldSwapchain, NULL);
+
+	if (!create_depth(vk))
+		return false;
+
+	vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &count, NULL);
+	images = calloc(count, sizeof(*images));
+	if (!check_alloc(images, count, "swapchain images"))
+		return false;
+	vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &count, images);
+
+	pool_size.descriptorCount = count;
+	pool.maxSets = count;
+	if (!check(vkCreateDescriptorPool(vk->device, &pool, NULL,
+					  &vk->descriptor_pool),
+		   "vkCreateDescriptorPool")) {
+		free(images);
+		return false;
+	}
+
+	vk->images = calloc(count, sizeof(*vk->images));
+	if (!check_alloc(vk->images, count, "swapchain images")) {
+		free(images);
+		return false;
+	}
+	vk->nimages = count;
+	for (i = 0; i < count; i++) {
+		vk->images[i].image = images[i];
+		if (!create_image(vk, &vk->images[i])) {
+			free(images);
+			return false;
+		}
+	}
+
+	free(images);
+	vk->resized = false;
+	return true;
+}
+
+struct vkrender *
+vkrender_create(struct wl_display *display, struct wl_surface *surface,
+		bool vsync, bool opaque, int frames_in_flight)
+{
+	struct vkrender *vk;
+
+	vk = calloc(1, sizeof *vk);
+	if (vk == NULL)
+		return NULL;
+
+	vk->vsync = vsync;
+	vk->opaque = opaque;
+	vk->nframes = frames_in_flight > 0 ? frames_in_flight : 1;
+
+	if (!create_instance(vk, display, surface) ||
+	    !pick_device(vk) ||
+	    !create_device(vk)) {
+		vkrender_destroy(vk);
+		return NULL;
+	}
+
+	if (!choose_surface_config(vk) ||
+	    !create_render_pass(vk) ||
+	    !create_pipeline(vk) ||
+	    !create_frames(vk)) {
+		vkrender_destroy(vk);
+		return NULL;
+	}
+
+	return vk;
+}
+
+void
+vkrender_destroy(struct vkrender *vk)
+{
+	int i;
+
+	if (vk->device != VK_NULL_HANDLE) {
+		vkDeviceWaitIdle(vk->device);
+
+		destroy_swapchain_resources(vk);
+		vkDestroySwapchainKHR(vk->device, vk->swapchain, NULL);
+
+		for (i = 0; vk->frames && i < vk->nframes; i++) {
+			vkDestroySemaphore(vk->device,
+					   vk->frames[i].image_available, NULL);
+			vkDestroyFence(vk->device, vk->frames[i].fence, NULL);
+		}
+
+		vkDestroyBuffer(vk->device, vk->vertex_buffer, NULL);
+		vkFreeMemory(vk->device, vk->vertex_memory, NULL);
+		vkDestroyPipeline(vk->device, vk->pipeline, NULL);
+		vkDestroyPipelineLayout(vk->device, vk->pipeline_layout, NULL);
+		vkDestroyDescriptorSetLayout(vk->device, vk->set_layout, NULL);
+		vkDestroyRenderPass(vk->device, vk->render_pass, NULL);
+		vkDestroyCommandPool(vk->device, vk->command_pool, NULL);
+		vkDestroyDevice(vk->device, NULL);
+	}
+
+	if (vk->instance != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(vk->instance, vk->surface, NULL);
+		vkDestroyInstance(vk->instance, NULL);
+	}
+
+	free(vk->frames);
+	free(vk->meshes);
+	free(vk->gears);
+	free(vk);
+}
+
+const char *
+vkrender_device_name(struct vkrender *vk)
+{
+	return vk->properties.deviceName;
+}
+
+bool
+vkrender_set_scene(struct vkrender *vk,
+		   const struct vkrender_mesh *meshes, int nmeshes,
+		   const struct vkrender_gear *gears, int ngears)
+{
+	uint32_t total = 0;
+	float *map;
+	int i;
+
+	/* All meshes share one vertex buffer */
+	vk->meshes = calloc(nmeshes, sizeof(*vk->meshes));
+	if (!check_alloc(vk->meshes, nmeshes, "meshes"))
+		return false;
+	vk->nmeshes = nmeshes;
+	for (i = 0; i < nmeshes; i++) {
+		vk->meshes[i].first = total;
+		vk->meshes[i].count = meshes[i].count;
+		total += meshes[i].count;
+	}
+
+	if (!create_mapped_buffer(vk, (VkDeviceSize)total * 6 * sizeof(float),
+				  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				  &vk->vertex_buffer, &vk->vertex_memory,
+				  (void **)&map))
+		return false;
+
+	for (i = 0; i < nmeshes; i++)
+		memcpy(map + vk->meshes[i].first * 6, meshes[i].vertices,
+		       meshes[i].count * 6 * sizeof(float));
+	vkUnmapMemory(vk->device, vk->vertex_memory);
+
+	vk->gears = calloc(ngears, sizeof(*vk->gears));
+	if (!check_alloc(vk->gears, ngears, "gears"))
+		return false;
+	memcpy(vk->gears, gears, ngears * sizeof(*gears));
+	vk->ngears = ngears;
+
+	/* The command buffers are recorded with the swapchain */
+	vk->resized = true;
+	return true;
+}
+
+void
+vkrender_resize(struct vkrender *vk, int width, int height)
+{
+	if (width == vk->width && height == vk->height)
+		return;
+
+	vk->width = width;
+	vk->height = height;
+	vk->resized = true;
+}
+
+/**
+ * Converts an OpenGL projection to the Vulkan clip space, with y pointing
+ * down and depth ranging from 0 to 1.
+ */
+static void
+convert_projection(float out[16], const float projection[16])
+{
+	int c;
+
+	for (c = 0; c < 4; c++) {
+		out[c * 4 + 0] = projection[c * 4 + 0];
+		out[c * 4 + 1] = -projection[c * 4 + 1];
+		out[c * 4 + 2] = 0.5f * (projection[c * 4 + 2] +
+					 projection[c * 4 + 3]);
+		out[c * 4 + 3] = projection[c * 4 + 3];
+	}
+}
+
+bool
+vkrender_draw(struct vkrender *vk, const float projection[16],
+	      const float view[16], const float light[4], float angle)
+{
+	struct vk_frame *frame = &vk->frames[vk->frame];
+	struct vk_image *image;
+	struct vk_uniforms *uniforms;
+	VkPipelineStageFlags wait_stage =
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	VkSubmitInfo submit = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &frame->image_available,
+		.pWaitDstStageMask = &wait_stage,
+		.commandBufferCount = 1,
+		.signalSemaphoreCount = 1,
+	};
+	VkPresentInfoKHR present = {
+		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+		.waitSemaphoreCount = 1,
+		.swapchainCount = 1,
+	};
+	VkResult result;
+	uint32_t index;
+
+	if (vk->resized && !create_swapchain(vk))
+		return false;
+
+	vkWaitForFences(vk->device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+
+	result = vkAcquireNextImageKHR(vk->device, vk->swapchain, UINT64_MAX,
+				       frame->image_available, VK_NULL_HANDLE,
+				       &index);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		vk->resized = true;
+		return true;
+	} else if (result != VK_SUBOPTIMAL_KHR &&
+		   !check(result, "vkAcquireNextImageKHR")) {
+		return false;
+	}
+
+	/* Another frame slot may still be rendering to the image */
+	image = &vk->images[index];
+	if (image->fence != VK_NULL_HANDLE && image->fence != frame->fence)
+		vkWaitForFences(vk->device, 1, &image->fence, VK_TRUE,
+				UINT64_MAX);
+	image->fence = frame->fence;
+
+	uniforms = image->uniforms;
+	convert_projection(uniforms->projection, projection);
+	memcpy(uniforms->view, view, sizeof(uniforms->view));
+	memcpy(uniforms->light, light, sizeof(uniforms->light));
+	uniforms->angle[0] = angle;
+
+	vkResetFences(vk->device, 1, &frame->fence);
+
+	submit.pCommandBuffers = &image->cmd;
+	submit.pSignalSemaphores = &image->render_finished;
+	if (!check(vkQueueSubmit(vk->queue, 1, &submit, frame->fence),
+		   "vkQueueSubmit"))
+		return false;
+
+	present.pWaitSemaphores = &image->render_finished;
+	present.pSwapchains = &vk->swapchain;
+	present.pImageIndices = &index;
+	result = vkQueuePresentKHR(vk->queue, &present);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		vk->resized = true;
+	else if (!check(result, "vkQueuePresentKHR"))
+		return false;
+
+	vk->frame = (vk->frame + 1) % vk->nframes;
+	return true;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2026 wlgears contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VKRENDER_H
+#define VKRENDER_H
+
+#include <stdbool.h>
+
+struct wl_display;
+struct wl_surface;
+
+/**
+ * A Vulkan renderer presenting to a Wayland surface.
+ *
+ * The draw commands of the whole scene are recorded once per swapchain
+ * image and replayed every frame; only a small uniform buffer holding the
+ * view, projection and rotation angle is updated per frame. The command
+ * buffers are recorded again when the swapchain is recreated.
+ */
+struct vkrender;
+
+/**
+ * A gear mesh, a triangle strip of 6 floats per vertex: the position
+ * followed by the normal.
+ */
+struct vkrender_mesh {
+	const float *vertices;
+	int count;
+};
+
+/**
+ * A placed gear, rotating by ratio * angle + phase degrees around z.
+ */
+struct vkrender_gear {
+	int mesh;
+	float x, y, ratio, phase;
+	float color[4];
+};
+
+/**
+ * Creates a renderer for a surface.
+ *
+ * @param display the Wayland display
+ * @param surface the surface to present to
+ * @param vsync whether presentation waits for the vertical blank
+ * @param opaque whether the surface is opaque
+ * @param frames_in_flight the maximum number of frames queued on the GPU
+ *
+ * @return the renderer or NULL on failure
+ */
+struct vkrender *
+vkrender_create(struct wl_display *display, struct wl_surface *surface,
+		bool vsync, bool opaque, int frames_in_flight);
+
+void
+vkrender_destroy(struct vkrender *vk);
+
+/**
+ * @return the name of the physical device rendering
+ */
+const char *
+vkrender_device_name(struct vkrender *vk);
+
+/**
+ * Uploads the meshes and sets the gears drawn every frame.
+ *
+ * @return false on failure
+ */
+bool
+vkrender_set_scene(struct vkrender *vk,
+		   const struct vkrender_mesh *meshes, int nmeshes,
+		   const struct vkrender_gear *gears, int ngears);
+
+/**
+ * Sets the size of the surface, the swapchain is recreated on the next
+ * frame.
+ */
+void
+vkrender_resize(struct vkrender *vk, int width, int height);
+
+/**
+ * Renders and presents a frame.
+ *
+ * @param projection the OpenGL style column-major projection matrix
+ * @param view the column-major view matrix
+ * @param light the direction of the directional light in eye coordinates
+ * @param angle the rotation angle of the gears in degrees
+ *
+ * @return false on failure
+ */
+bool
+vkrender_draw(struct vkrender *vk, const float projection[16],
+	      const float view[16], const float light[4], float angle);
+
+#endif
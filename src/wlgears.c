@@ -55,6 +55,10 @@
 #include <math.h>
 #include <assert.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 
 #include <linux/input.h>
 
@@ -67,15 +71,33 @@
 #include <EGL/eglext.h>
 
 #include "xdg-shell-client-protocol.h"
+#include "viewporter-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
+#include "gear.h"
+#include "matrix.h"
+#include "pool.h"
+#include "scene.h"
+#include "swrast.h"
+#include "trace.h"
+#ifdef HAVE_BAKED_MESHES
+#include "baked-meshes.h"
+#endif
+#ifdef HAVE_VULKAN
+#include "vkrender.h"
+#endif
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifndef ARRAY_LENGTH
@@ -84,19 +106,70 @@
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
+/** The smallest render scale the dynamic resolution controller picks */
+#define DYNRES_MIN_SCALE 0.25
+/** The number of frames between dynamic resolution adjustments */
+#define DYNRES_INTERVAL 15
+
+/** The time in ms after which a missing frame callback means the window is hidden */
+#define FRAME_CALLBACK_TIMEOUT 250.0
+
+/* The suspended state needs xdg_wm_base version 6 */
+#ifdef XDG_TOPLEVEL_STATE_SUSPENDED_SINCE_VERSION
+#define XDG_WM_BASE_VERSION XDG_TOPLEVEL_STATE_SUSPENDED_SINCE_VERSION
+#else
+#define XDG_WM_BASE_VERSION 1
+#endif
+
 struct window;
 struct seat;
 
+enum input_type {
+	INPUT_MOTION,
+	INPUT_BUTTON,
+	INPUT_KEY,
+	INPUT_RELATIVE,
+};
+
+static const char *const input_names[] = {
+	[INPUT_MOTION] = "motion",
+	[INPUT_BUTTON] = "button",
+	[INPUT_KEY] = "key",
+	[INPUT_RELATIVE] = "relative",
+};
+
+/**
+ * Struct representing a recorded input event.
+ */
+struct recorded_input {
+	/** The time in ms since the first frame */
+	double time;
+	enum input_type type;
+	/**
+	 * The surface coordinates or relative motion in wl_fixed_t, or the
+	 * button or key and state
+	 */
+	int32_t a, b;
+};
+
 struct display {
 	struct wl_display *display;
 	struct wl_registry *registry;
 	struct wl_compositor *compositor;
 	struct xdg_wm_base *wm_base;
 	struct wl_seat *seat;
+	/** The bound version of wl_seat, pointer frames need version 5 */
+	uint32_t seat_version;
 	struct wl_pointer *pointer;
+	struct zwp_relative_pointer_manager_v1 *relative_pointer_manager;
+	struct zwp_relative_pointer_v1 *relative_pointer;
 	struct wl_touch *touch;
 	struct wl_keyboard *keyboard;
 	struct wl_shm *shm;
+	struct wp_viewporter *viewporter;
+	struct wp_presentation *presentation;
+	/** The clock of the presentation timestamps */
+	uint32_t presentation_clock;
 	struct wl_cursor_theme *cursor_theme;
 	struct wl_cursor *default_cursor;
 	struct wl_surface *cursor_surface;
@@ -104,16 +177,75 @@ struct display {
 		EGLDisplay dpy;
 		EGLContext ctx;
 		EGLConfig conf;
+		/* EGL_KHR_fence_sync entry points, NULL if unsupported */
+		PFNEGLCREATESYNCKHRPROC create_sync;
+		PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+		PFNEGLDESTROYSYNCKHRPROC destroy_sync;
 	} egl;
 	struct window *window;
 
 	PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC swap_buffers_with_damage;
+
+	/* Pointer motion accumulated until the end of its wl_pointer.frame */
+	struct {
+		/** The latest surface position */
+		wl_fixed_t x, y;
+		/** The surface position the rotation was last updated from */
+		wl_fixed_t applied_x, applied_y;
+		/** The accumulated relative motion in surface units */
+		double dx, dy;
+		/** The time of the first motion of the frame in ms */
+		double time;
+		bool motion, relative;
+	} pointer_frame;
+
+	/* Event loop state */
+	struct {
+		int epoll_fd, timer_fd, signal_fd;
+		/** Whether the socket did not take all requests at the last flush */
+		bool flush_blocked;
+		/** Whether the timer expired since it was last armed */
+		bool timer_expired;
+		/** The number of times the loop woke up from a wait in the interval */
+		long wakeups;
+	} loop;
+
+	/* Input recording and replay state */
+	struct {
+		/** The start time of the first frame in ms */
+		double epoch;
+		/** The file input is recorded to, NULL if not recording */
+		FILE *record;
+		/** The events to replay, NULL if not replaying */
+		struct recorded_input *replay;
+		int count, next;
+	} input;
 };
 
 struct geometry {
 	int width, height;
 };
 
+enum backend {
+	BACKEND_GL,
+	BACKEND_CPU,
+	BACKEND_VULKAN,
+};
+
+#define SHM_BUFFER_COUNT 3
+
+/**
+ * Struct representing a wl_shm buffer the CPU renderer draws into.
+ */
+struct shm_buffer {
+	struct wl_buffer *buffer;
+	uint32_t *data;
+	size_t size;
+	int width, height;
+	/** Whether the compositor still holds the buffer */
+	bool busy;
+};
+
 struct window {
 	struct display *display;
 	struct geometry geometry, window_size;
@@ -121,6 +253,8 @@ struct window {
 		GLuint rotation_uniform;
 		GLuint pos;
 		GLuint col;
+		GLuint program;
+		GLuint depth_program;
 	} gl;
 
 	uint32_t benchmark_time, frames;
@@ -130,487 +264,696 @@ struct window {
 	struct xdg_toplevel *xdg_toplevel;
 	EGLSurface egl_surface;
 	struct wl_callback *callback;
-	int fullscreen, maximized, opaque, buffer_size, frame_sync, delay;
+	/** The time the pending frame callback was requested in ms */
+	double callback_time;
+	struct wp_viewport *viewport;
+	int fullscreen, maximized, opaque, buffer_size, frame_sync;
+	/** Whether the compositor suspended the window */
+	bool suspended;
+	/** The time spent throttled in the interval and in total in ms */
+	double throttled, throttled_total;
+	int grid, lod, cull, occlusion, sort, depth_prepass;
+	/** The scene file, NULL for the classic gear train */
+	const char *scene_path;
+	/** Whether the CPU copies of the meshes are kept after the upload */
+	bool keep_meshes;
+	/** The bytes of GPU buffers holding meshes */
+	size_t mesh_gpu_bytes;
+	int per_pixel, lights, alu_loops;
+	enum backend backend;
+	/** The number of CPU rasterizer threads */
+	int threads;
+	/** The number of threads updating the scene state, 0 for none */
+	int update_threads;
+	/** The time spent updating the scene state and the stolen chunks */
+	struct {
+		double time;
+		int steals;
+	} update;
+	struct swrast *swrast;
+	struct shm_buffer shm_buffers[SHM_BUFFER_COUNT];
+#ifdef HAVE_VULKAN
+	struct vkrender *vk;
+#endif
+	/** The maximum number of frames queued on the GPU */
+	int frames_in_flight;
+
+	/* GL frame pipelining state */
+	struct {
+		/** The fences of the frames in flight, NULL without fence syncs */
+		EGLSyncKHR *fences;
+		/** The fence slot of the next frame */
+		int next;
+		/** The sum of the frames still queued on the GPU at frame start */
+		long queued;
+		/** The time spent waiting for fences in the interval in ms */
+		double blocked;
+	} pipeline;
 	bool wait_for_configure;
+	/** The number of triangles drawn in the current interval */
+	long triangles;
+	/** The number of gears drawn, frustum culled and occluded in the interval */
+	long drawn, culled, occluded;
+	/** The number of depth prepass draws in the interval */
+	long prepass_draws;
+	/** The pointer motion events and rotation updates in the interval */
+	long pointer_events, pointer_updates;
+	/** The time spent dispatching events in the interval in ms */
+	double dispatch_time;
+
+	/** The resource usage at the start of the interval */
+	struct rusage rusage;
+
+	/* Frame rate limiter state */
+	struct {
+		/** The frame interval in ns, 0 if the frame rate is not capped */
+		int64_t interval;
+		/** The time spun before each deadline instead of sleeping in ns */
+		int64_t spin;
+		/** The start time of the next frame on the monotonic clock in ns */
+		int64_t deadline;
+		/** The wake up errors of the interval in µs */
+		double *errors;
+		int count, capacity;
+		/** The number of deadlines of the interval missed by over a frame */
+		long missed;
+	} pacing;
+
+	/* Input to display latency state */
+	struct {
+		/** The time of the oldest input no frame has used yet in ms, 0 if none */
+		double pending;
+		/** The latencies of the interval in ms */
+		double *samples;
+		int count, capacity;
+		/** The number of frames of the interval that were never displayed */
+		long discarded;
+	} latency;
+
+	/* Timed run state */
+	struct {
+		/** The run time in seconds, 0 to run until interrupted */
+		double duration;
+		/** The end times of the first and the previous frame in ms */
+		double start, last;
+		/** The frame times in ms */
+		double *times;
+		int count, capacity;
+		/** The resource usage at the end of the first frame */
+		struct rusage rusage;
+	} run;
+
+	/* Dynamic resolution state */
+	struct {
+		/** The target frame time in ms, 0 if disabled */
+		double target;
+		/** The current render resolution scale */
+		double scale;
+		/** The smoothed frame time in ms */
+		double avg;
+		/** The end time of the previous frame in ms */
+		double last;
+		/** The time spent over budget in the current interval in ms */
+		double over_budget;
+		int frames;
+		/** The current render resolution */
+		int width, height;
+	} dynres;
 };
 
 static int running = 1;
 
-#define STRIPS_PER_TOOTH 7
-#define VERTICES_PER_TOOTH 46
-#define GEAR_VERTEX_STRIDE 6
+/**
+ * Returns the current time of the monotonic clock in milliseconds.
+ */
+static double
+get_time_ms(void)
+{
+	struct timespec ts;
 
-/* Each vertex consist of GEAR_VERTEX_STRIDE GLfloat attributes */
-typedef GLfloat GearVertex[GEAR_VERTEX_STRIDE];
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
 
 /**
- * Struct representing a gear.
+ * Returns the current time of the monotonic clock in nanoseconds.
  */
-struct gear {
-	/** The array of vertices comprising the gear */
-	GearVertex *vertices;
-	/** The number of vertices comprising the gear */
-	int nvertices;
-	/** The Vertex Buffer Object holding the vertices in the graphics card */
-	GLuint vbo;
-};
+static int64_t
+get_time_ns(void)
+{
+	struct timespec ts;
 
-/** The view rotation [x, y, z] */
-static GLfloat view_rot[3] = { 20.0, 30.0, 0.0 };
-/** The gears */
-static struct gear *gear1, *gear2, *gear3;
-/** The current gear rotation angle */
-static GLfloat angle = 0.0;
-/** The location of the shader uniforms */
-static GLuint ModelViewProjectionMatrix_location,
-		NormalMatrix_location,
-		LightSourcePosition_location,
-		MaterialColor_location;
-/** The projection matrix */
-static GLfloat ProjectionMatrix[16];
-/** The direction of the directional light for the scene */
-static const GLfloat LightSourcePosition[4] = { 5.0, 5.0, 10.0, 1.0};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
 
 /**
- * Fills a gear vertex.
+ * Sets up the epoll set of the main loop.
  *
- * @param v the vertex to fill
- * @param x the x coordinate
- * @param y the y coordinate
- * @param z the z coortinate
- * @param n pointer to the normal table
+ * SIGINT is blocked and read from a signalfd, so it has to be set up
+ * before any other thread is started.
  *
- * @return the operation error code
+ * @param display the display to watch
  */
-static GearVertex *
-vert(GearVertex *v, GLfloat x, GLfloat y, GLfloat z, GLfloat n[3])
+static void
+init_event_loop(struct display *display)
 {
-	v[0][0] = x;
-	v[0][1] = y;
-	v[0][2] = z;
-	v[0][3] = n[0];
-	v[0][4] = n[1];
-	v[0][5] = n[2];
+	struct epoll_event event = { .events = EPOLLIN };
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	display->loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	display->loop.signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	display->loop.timer_fd = timerfd_create(CLOCK_MONOTONIC,
+						TFD_CLOEXEC | TFD_NONBLOCK);
+	if (display->loop.epoll_fd < 0 || display->loop.signal_fd < 0 ||
+	    display->loop.timer_fd < 0) {
+		perror("failed to set up the event loop");
+		exit(EXIT_FAILURE);
+	}
+
+	event.data.fd = wl_display_get_fd(display->display);
+	epoll_ctl(display->loop.epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event);
+	event.data.fd = display->loop.signal_fd;
+	epoll_ctl(display->loop.epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event);
+	event.data.fd = display->loop.timer_fd;
+	epoll_ctl(display->loop.epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event);
+}
 
-	return v + 1;
+static void
+finish_event_loop(struct display *display)
+{
+	close(display->loop.timer_fd);
+	close(display->loop.signal_fd);
+	close(display->loop.epoll_fd);
 }
 
 /**
- *  Create a gear wheel.
+ * Sends the queued requests without blocking.
+ *
+ * When the socket is full, the loop watches it for writability and
+ * flushes the rest once the compositor caught up.
  *
- *  @param inner_radius radius of hole at center
- *  @param outer_radius radius at center of teeth
- *  @param width width of gear
- *  @param teeth number of teeth
- *  @param tooth_depth depth of tooth
+ * @param display the display to flush
  *
- *  @return pointer to the constructed struct gear
+ * @return -1 on failure
  */
-static struct gear *
-create_gear(GLfloat inner_radius, GLfloat outer_radius, GLfloat width,
-		GLint teeth, GLfloat tooth_depth)
+static int
+flush_display(struct display *display)
 {
-	GLfloat r0, r1, r2;
-	GLfloat da;
-	GearVertex *v;
-	struct gear *gear;
-	double s[5], c[5];
-	GLfloat normal[3];
-	int cur_strip_start = 0;
-	int i;
-
-	/* Allocate memory for the gear */
-	gear = malloc(sizeof *gear);
-	if (gear == NULL)
-		return NULL;
+	struct epoll_event event = { .data.fd = wl_display_get_fd(display->display) };
+	int ret = wl_display_flush(display->display);
+	bool blocked = ret < 0 && errno == EAGAIN;
+
+	if (ret < 0 && !blocked)
+		return -1;
+	if (blocked != display->loop.flush_blocked) {
+		event.events = EPOLLIN | (blocked ? EPOLLOUT : 0);
+		epoll_ctl(display->loop.epoll_fd, EPOLL_CTL_MOD, event.data.fd,
+			  &event);
+		display->loop.flush_blocked = blocked;
+	}
 
-	/* Calculate the radii used in the gear */
-	r0 = inner_radius;
-	r1 = outer_radius - tooth_depth / 2.0;
-	r2 = outer_radius + tooth_depth / 2.0;
-
-	da = 2.0 * M_PI / teeth / 4.0;
-
-	/* the first tooth doesn't need the first strip-restart sequence */
-	assert(teeth > 0);
-	gear->nvertices = VERTICES_PER_TOOTH + (VERTICES_PER_TOOTH + 2) * (teeth - 1);
-
-	/* Allocate memory for the vertices */
-	gear->vertices = calloc(gear->nvertices, sizeof(*gear->vertices));
-	v = gear->vertices;
-
-	for (i = 0; i < teeth; i++) {
-		/* Calculate needed sin/cos for varius angles */
-		sincos(i * 2.0 * M_PI / teeth, &s[0], &c[0]);
-		sincos(i * 2.0 * M_PI / teeth + da, &s[1], &c[1]);
-		sincos(i * 2.0 * M_PI / teeth + da * 2, &s[2], &c[2]);
-		sincos(i * 2.0 * M_PI / teeth + da * 3, &s[3], &c[3]);
-		sincos(i * 2.0 * M_PI / teeth + da * 4, &s[4], &c[4]);
-
-		/* A set of macros for making the creation of the gears easier */
-#define  GEAR_POINT(r, da) { (r) * c[(da)], (r) * s[(da)] }
-#define  SET_NORMAL(x, y, z) do { \
-	normal[0] = (x); normal[1] = (y); normal[2] = (z); \
-} while(0)
-
-#define  GEAR_VERT(v, point, sign) vert((v), p[(point)].x, p[(point)].y, (sign) * width * 0.5, normal)
-
-#define START_STRIP do { \
-	cur_strip_start = (v - gear->vertices); \
-	if (cur_strip_start) \
-		v += 2; \
-} while(0);
-
-/* emit prev last vertex
-	emit first vertex */
-#define END_STRIP do { \
-	if (cur_strip_start) { \
-		memcpy(gear->vertices + cur_strip_start, \
-				 gear->vertices + (cur_strip_start - 1), sizeof(GearVertex)); \
-		memcpy(gear->vertices + cur_strip_start + 1, \
-				 gear->vertices + (cur_strip_start + 2), sizeof(GearVertex)); \
-	} \
-} while (0)
-
-#define QUAD_WITH_NORMAL(p1, p2) do { \
-	SET_NORMAL((p[(p1)].y - p[(p2)].y), -(p[(p1)].x - p[(p2)].x), 0); \
-	v = GEAR_VERT(v, (p1), -1); \
-	v = GEAR_VERT(v, (p1), 1); \
-	v = GEAR_VERT(v, (p2), -1); \
-	v = GEAR_VERT(v, (p2), 1); \
-} while(0)
-
-		struct point {
-			GLfloat x;
-			GLfloat y;
-		};
-
-		/* Create the 7 points (only x,y coords) used to draw a tooth */
-		struct point p[7] = {
-			GEAR_POINT(r2, 1), // 0
-			GEAR_POINT(r2, 2), // 1
-			GEAR_POINT(r1, 0), // 2
-			GEAR_POINT(r1, 3), // 3
-			GEAR_POINT(r0, 0), // 4
-			GEAR_POINT(r1, 4), // 5
-			GEAR_POINT(r0, 4), // 6
-		};
-
-		/* Front face */
-		START_STRIP;
-		SET_NORMAL(0, 0, 1.0);
-		v = GEAR_VERT(v, 0, +1);
-		v = GEAR_VERT(v, 1, +1);
-		v = GEAR_VERT(v, 2, +1);
-		v = GEAR_VERT(v, 3, +1);
-		v = GEAR_VERT(v, 4, +1);
-		v = GEAR_VERT(v, 5, +1);
-		v = GEAR_VERT(v, 6, +1);
-		END_STRIP;
-
-		/* Back face */
-		START_STRIP;
-		SET_NORMAL(0, 0, -1.0);
-		v = GEAR_VERT(v, 0, -1);
-		v = GEAR_VERT(v, 1, -1);
-		v = GEAR_VERT(v, 2, -1);
-		v = GEAR_VERT(v, 3, -1);
-		v = GEAR_VERT(v, 4, -1);
-		v = GEAR_VERT(v, 5, -1);
-		v = GEAR_VERT(v, 6, -1);
-		END_STRIP;
-
-		/* Outer face */
-		START_STRIP;
-		QUAD_WITH_NORMAL(0, 2);
-		END_STRIP;
-
-		START_STRIP;
-		QUAD_WITH_NORMAL(1, 0);
-		END_STRIP;
-
-		START_STRIP;
-		QUAD_WITH_NORMAL(3, 1);
-		END_STRIP;
-
-		START_STRIP;
-		QUAD_WITH_NORMAL(5, 3);
-		END_STRIP;
-
-		/* Inner face */
-		START_STRIP;
-		SET_NORMAL(-c[0], -s[0], 0);
-		v = GEAR_VERT(v, 4, -1);
-		v = GEAR_VERT(v, 4, 1);
-		SET_NORMAL(-c[4], -s[4], 0);
-		v = GEAR_VERT(v, 6, -1);
-		v = GEAR_VERT(v, 6, 1);
-		END_STRIP;
-	}
-
-	assert(gear->nvertices == (v - gear->vertices));
-
-	/* Store the vertices in a vertex buffer object (VBO) */
-	glGenBuffers(1, &gear->vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, gear->vbo);
-	glBufferData(GL_ARRAY_BUFFER, gear->nvertices * sizeof(GearVertex),
-			gear->vertices, GL_STATIC_DRAW);
-
-	return gear;
+	return 0;
 }
 
 /**
- * Multiplies two 4x4 matrices.
+ * Reads and dispatches the events of the default queue.
  *
- * The result is stored in matrix m.
+ * @param display the display to dispatch
+ * @param timeout the longest time to wait for events in ms, -1 to wait
+ * until any watched fd is ready or 0 to not block
  *
- * @param m the first matrix to multiply
- * @param n the second matrix to multiply
+ * @return the number of events dispatched or -1 on failure
  */
-static void
-multiply(GLfloat *m, const GLfloat *n)
+static int
+wait_events(struct display *display, int timeout)
 {
-	GLfloat tmp[16];
-	const GLfloat *row, *column;
-	div_t d;
-	int i, j;
+	struct epoll_event events[3];
+	struct signalfd_siginfo info;
+	int wl_fd = wl_display_get_fd(display->display);
+	bool readable = false;
+	uint64_t expirations;
+	int i, n;
+
+	while (wl_display_prepare_read(display->display) != 0)
+		wl_display_dispatch_pending(display->display);
+	if (flush_display(display) < 0) {
+		wl_display_cancel_read(display->display);
+		return -1;
+	}
 
-	for (i = 0; i < 16; i++) {
-		tmp[i] = 0;
-		d = div(i, 4);
-		row = n + d.quot * 4;
-		column = m + d.rem;
-		for (j = 0; j < 4; j++)
-			tmp[i] += row[j] * column[j * 4];
+	n = epoll_wait(display->loop.epoll_fd, events, ARRAY_LENGTH(events),
+		       timeout);
+	if (timeout != 0)
+		display->loop.wakeups++;
+
+	for (i = 0; i < n; i++) {
+		if (events[i].data.fd == display->loop.signal_fd) {
+			if (read(display->loop.signal_fd, &info, sizeof info) > 0)
+				running = 0;
+		} else if (events[i].data.fd == display->loop.timer_fd) {
+			if (read(display->loop.timer_fd, &expirations,
+				 sizeof expirations) > 0)
+				display->loop.timer_expired = true;
+		} else if (events[i].data.fd == wl_fd) {
+			if (events[i].events & EPOLLOUT)
+				flush_display(display);
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
+				running = 0;
+			readable = events[i].events & EPOLLIN;
+		}
+	}
+
+	if (readable) {
+		if (wl_display_read_events(display->display) < 0)
+			return -1;
+	} else {
+		wl_display_cancel_read(display->display);
 	}
-	memcpy(m, &tmp, sizeof tmp);
+
+	return wl_display_dispatch_pending(display->display);
 }
 
 /**
- * Rotates a 4x4 matrix.
- *
- * @param[in,out] m the matrix to rotate
- * @param angle the angle to rotate
- * @param x the x component of the direction to rotate to
- * @param y the y component of the direction to rotate to
- * @param z the z component of the direction to rotate to
+ * Dispatches the events that are queued or readable without blocking.
  */
-static void
-rotate(GLfloat *m, GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
+static int
+dispatch_events(struct display *display)
 {
-	double s, c;
+	return wait_events(display, 0);
+}
 
-	sincos(angle, &s, &c);
-	GLfloat r[16] = {
-		x * x * (1 - c) + c,	  y * x * (1 - c) + z * s, x * z * (1 - c) - y * s, 0,
-		x * y * (1 - c) - z * s, y * y * (1 - c) + c,	  y * z * (1 - c) + x * s, 0,
-		x * z * (1 - c) + y * s, y * z * (1 - c) - x * s, z * z * (1 - c) + c,	  0,
-		0, 0, 0, 1
-	};
+/** The projected radius in pixels below which a coarser level is used */
+#define GEAR_LOD1_PIXELS 48.0
+#define GEAR_LOD2_PIXELS 16.0
+/** The distance between the copies of the gear train in grid mode */
+#define GRID_SPACING 14.0
+/** The number of gears handed to an update thread at once */
+#define UPDATE_CHUNK 256
+/** The largest number of directional lights the shaders support */
+#define MAX_LIGHTS 8
+/** The number of trace events kept per thread */
+#define TRACE_EVENTS (1 << 18)
 
-	multiply(m, r);
-}
+/**
+ * Struct representing a gear placed in the scene.
+ */
+struct scene_gear {
+	/** The meshes of the gear, from the finest to the coarsest level */
+	struct gear *lod[GEAR_LOD_COUNT];
+	/** The index of the finest mesh in the mesh cache */
+	int mesh;
+	/** The position of the gear */
+	GLfloat x, y;
+	/** The rotation of the gear is ratio * angle + phase degrees */
+	GLfloat ratio, phase;
+	/** The color of the gear */
+	GLfloat color[4];
+	/** The occlusion query of the gear */
+	GLuint query;
+	/** Whether the query result has not been read back yet */
+	bool query_pending;
+	/** Whether the last query found the gear hidden */
+	bool occluded;
+	/** The view transformation times the translation of the gear */
+	GLfloat view_model[16];
+	/** The projection times view_model */
+	GLfloat projection_view_model[16];
+	/** The view serial the cached matrices were computed for */
+	unsigned int view_serial;
+};
+
+/**
+ * Struct representing a gear queued for drawing in the current frame.
+ */
+struct draw_item {
+	/** The gear to draw */
+	struct scene_gear *gear;
+	/** The mesh selected for the gear */
+	struct gear *mesh;
+	/** The depth of the gear center in eye coordinates */
+	GLfloat depth;
+};
+
+/** The view rotation [x, y, z] */
+static GLfloat view_rot[3] = { 20.0, 30.0, 0.0 };
+/** The gears in the scene */
+static struct scene_gear *scene;
+static int scene_count;
+/** The meshes shared by the gears of the scene */
+static struct mesh_cache *mesh_cache;
+/** The matrices of all gears, NULL if they are computed while drawing */
+static struct scene_state *scene_state;
+/** The threads updating scene_state */
+static struct pool *update_pool;
+/** The gears queued for drawing in the current frame */
+static struct draw_item *draw_list;
+/** The distance of the camera from the scene */
+static GLfloat view_distance = 40.0;
+/** The current gear rotation angle */
+static GLfloat angle = 0.0;
+/** The location of the shader uniforms */
+static GLuint ModelViewProjectionMatrix_location,
+		NormalMatrix_location,
+		LightSourcePosition_location,
+		MaterialColor_location,
+		DepthModelViewProjectionMatrix_location;
+/** The projection matrix */
+static GLfloat ProjectionMatrix[16];
+/** The view transformation, rebuilt only when its inputs change */
+static struct {
+	GLfloat transform[16];
+	/** The view_rot and view_distance the transformation was built from */
+	GLfloat rot[3], distance;
+	/** The frustum planes of the projection and view */
+	GLfloat planes[6][4];
+	/** The serial the frustum planes were extracted for */
+	unsigned int planes_serial;
+	/** Incremented whenever the view or the projection changes, 0 if unset */
+	unsigned int serial;
+	/** The matrix computations done and skipped in the interval */
+	long computed, skipped;
+} view;
+/** The direction of the directional light for the scene */
+static const GLfloat LightSourcePosition[4] = { 5.0, 5.0, 10.0, 1.0};
 
+/** The vertex buffer all meshes are packed into */
+static struct {
+	GLuint vbo;
+	/** Whether the strips of a gear are drawn with glMultiDrawArraysEXT */
+	bool multi_draw;
+	/** The buffer binds and draw calls in the interval */
+	long binds, draws;
+} arena;
 
 /**
- * Translates a 4x4 matrix.
+ * Uploads the vertices of all meshes into one vertex buffer object.
  *
- * @param[in,out] m the matrix to translate
- * @param x the x component of the direction to translate to
- * @param y the y component of the direction to translate to
- * @param z the z component of the direction to translate to
+ * @param window the window the meshes are drawn in
+ * @param cache the meshes to upload
  */
 static void
-translate(GLfloat *m, GLfloat x, GLfloat y, GLfloat z)
+upload_meshes(struct window *window, struct mesh_cache *cache)
 {
-	GLfloat t[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  x, y, z, 1 };
+	struct gear *gear;
+	int i, first = 0;
+
+	for (i = 0; i < mesh_cache_count(cache); i++)
+		first += mesh_cache_mesh(cache, i)->nvertices;
+
+	glGenBuffers(1, &arena.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+	glBufferData(GL_ARRAY_BUFFER, first * sizeof(GearVertex), NULL,
+		     GL_STATIC_DRAW);
+
+	for (i = 0, first = 0; i < mesh_cache_count(cache); i++) {
+		gear = mesh_cache_mesh(cache, i);
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(GearVertex),
+				gear->nvertices * sizeof(GearVertex),
+				gear->vertices);
+		gear->vbo = arena.vbo;
+		gear_set_first(gear, first);
+		first += gear->nvertices;
+		if (!window->keep_meshes)
+			gear_free_vertices(gear);
+	}
+	window->mesh_gpu_bytes = first * sizeof(GearVertex);
 
-	multiply(m, t);
+	arena.multi_draw = epoxy_has_gl_extension("GL_EXT_multi_draw_arrays");
+	printf("%d meshes (%d baked) in a %zu KiB vertex buffer, %s\n",
+	       mesh_cache_count(cache), mesh_cache_baked_count(cache),
+	       first * sizeof(GearVertex) / 1024,
+	       arena.multi_draw ? "multi-draw" : "single strips");
 }
 
 /**
- * Creates an identity 4x4 matrix.
- *
- * @param m the matrix make an identity matrix
+ * Binds the vertex buffer of the meshes for the gear draws of a frame.
  */
 static void
-identity(GLfloat *m)
+bind_meshes(void)
 {
-	GLfloat t[16] = {
-		1.0, 0.0, 0.0, 0.0,
-		0.0, 1.0, 0.0, 0.0,
-		0.0, 0.0, 1.0, 0.0,
-		0.0, 0.0, 0.0, 1.0,
-	};
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+	arena.binds++;
+
+	/* Set up the position of the attributes in the vertex buffer object */
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
+			6 * sizeof(GLfloat), NULL);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
+			6 * sizeof(GLfloat), (GLfloat *) 0 + 3);
+
+	/* Enable the attributes */
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+}
 
-	memcpy(m, t, sizeof(t));
+static void
+unbind_meshes(void)
+{
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(0);
 }
 
 /**
- * Transposes a 4x4 matrix.
+ * Draws the triangle strips that comprise a gear.
  *
- * @param m the matrix to transpose
+ * With multi-draw, the strips are drawn separately in one call, which
+ * skips the degenerate triangles joining them.
+ *
+ * @param gear the gear to draw
  */
 static void
-transpose(GLfloat *m)
+draw_strips(struct gear *gear)
 {
-	GLfloat t[16] = {
-		m[0], m[4], m[8],  m[12],
-		m[1], m[5], m[9],  m[13],
-		m[2], m[6], m[10], m[14],
-		m[3], m[7], m[11], m[15]};
+	if (arena.multi_draw)
+		glMultiDrawArraysEXT(GL_TRIANGLE_STRIP, gear->strip_first,
+				     gear->strip_count, gear->nstrips);
+	else
+		glDrawArrays(GL_TRIANGLE_STRIP, gear->first, gear->nvertices);
+	arena.draws++;
+}
 
-	memcpy(m, t, sizeof(t));
+/**
+ * Marks the view transformation and the matrices derived from it stale.
+ */
+static void
+invalidate_view(void)
+{
+	view.serial++;
+	if (view.serial == 0)
+		view.serial++;
 }
 
 /**
- * Inverts a 4x4 matrix.
+ * Returns the view transformation, rebuilding it if view_rot or
+ * view_distance changed.
  *
- * This function can currently handle only pure translation-rotation matrices.
- * Read http://www.gamedev.net/community/forums/topic.asp?topic_id=425118
- * for an explanation.
+ * @param transform the matrix to fill with the view transformation
  */
 static void
-invert(GLfloat *m)
+update_view(GLfloat *transform)
 {
-	GLfloat t[16];
-	identity(t);
+	if (view.serial != 0 && view.distance == view_distance &&
+	    memcmp(view.rot, view_rot, sizeof view.rot) == 0) {
+		view.skipped++;
+	} else {
+		identity(view.transform);
+		translate(view.transform, 0, 0, -view_distance);
+		rotate(view.transform, 2 * M_PI * view_rot[0] / 360.0, 1, 0, 0);
+		rotate(view.transform, 2 * M_PI * view_rot[1] / 360.0, 0, 1, 0);
+		rotate(view.transform, 2 * M_PI * view_rot[2] / 360.0, 0, 0, 1);
+		memcpy(view.rot, view_rot, sizeof view.rot);
+		view.distance = view_distance;
+		invalidate_view();
+		view.computed++;
+	}
 
-	// Extract and invert the translation part 't'. The inverse of a
-	// translation matrix can be calculated by negating the translation
-	// coordinates.
-	t[12] = -m[12]; t[13] = -m[13]; t[14] = -m[14];
+	memcpy(transform, view.transform, sizeof view.transform);
+}
 
-	// Invert the rotation part 'r'. The inverse of a rotation matrix is
-	// equal to its transpose.
-	m[12] = m[13] = m[14] = 0;
-	transpose(m);
+static void
+update_scene_range(void *data, int begin, int end)
+{
+	scene_state_update(scene_state, data, begin, end);
+}
 
-	// inv(m) = inv(r) * inv(t)
-	multiply(m, t);
+/**
+ * Computes the matrices of all gears for this frame on the update threads.
+ *
+ * @param window the window drawing the scene
+ * @param transform the view transformation
+ */
+static void
+update_scene(struct window *window, const GLfloat *transform)
+{
+	struct scene_view scene_view;
+	double start = get_time_ms();
+
+	memcpy(scene_view.view, transform, sizeof scene_view.view);
+	memcpy(scene_view.projection_view, ProjectionMatrix,
+	       sizeof scene_view.projection_view);
+	multiply(scene_view.projection_view, transform);
+	scene_view.angle = angle;
+
+	window->update.steals += pool_run(update_pool, scene_state->count,
+					  UPDATE_CHUNK, update_scene_range,
+					  &scene_view);
+	window->update.time += get_time_ms() - start;
 }
 
 /**
- * Calculate a frustum projection transformation.
- *
- * @param m the matrix to save the transformation in
- * @param l the left plane distance
- * @param r the right plane distance
- * @param b the bottom plane distance
- * @param t the top plane distance
- * @param n the near plane distance
- * @param f the far plane distance
+ * Calculates the matrices used to draw a gear.
+ *
+ * The view and projection times the translation of the gear are cached
+ * in the gear until the view or projection changes, so a frame only adds
+ * the rotation of the gear.
+ *
+ * @param g the gear to calculate the matrices of
+ * @param angle the rotation angle of the gear
+ * @param model_view_projection the ModelViewProjectionMatrix to fill
+ * @param normal_matrix the NormalMatrix to fill, may be NULL
  */
 static void
-frustum(GLfloat *m, GLfloat l, GLfloat r, GLfloat b, GLfloat t, GLfloat n, GLfloat f)
+gear_matrices(struct scene_gear *g, GLfloat angle,
+	      GLfloat *model_view_projection, GLfloat *normal_matrix)
 {
-	GLfloat tmp[16];
-	identity(tmp);
+	/* The matrices of this frame were already computed by update_scene() */
+	if (scene_state) {
+		int i = g - scene;
+
+		memcpy(model_view_projection, &scene_state->mvp[16 * i],
+		       16 * sizeof(GLfloat));
+		if (normal_matrix)
+			memcpy(normal_matrix, &scene_state->normal[16 * i],
+			       16 * sizeof(GLfloat));
+		return;
+	}
+
+	if (g->view_serial != view.serial) {
+		memcpy(g->view_model, view.transform, sizeof g->view_model);
+		translate(g->view_model, g->x, g->y, 0);
+		memcpy(g->projection_view_model, ProjectionMatrix,
+		       sizeof g->projection_view_model);
+		multiply(g->projection_view_model, g->view_model);
+		g->view_serial = view.serial;
+		view.computed++;
+	} else {
+		view.skipped++;
+	}
 
-	GLfloat deltaX = r - l;
-	GLfloat deltaY = t - b;
-	GLfloat deltaZ = f - n;
+	/* Rotate the gear */
+	memcpy(model_view_projection, g->projection_view_model,
+	       sizeof g->projection_view_model);
+	rotate(model_view_projection, 2 * M_PI * angle / 360.0, 0, 0, 1);
 
-	tmp[0] = (2 * n) / deltaX;
-	tmp[5] = (2 * n) / deltaY;
-	tmp[8] = (r + l) / deltaX;
-	tmp[9] = (t + b) / deltaY;
-	tmp[10] = -(f + n) / deltaZ;
-	tmp[11] = -1;
-	tmp[14] = -(2 * f * n) / deltaZ;
-	tmp[15] = 0;
+	if (normal_matrix == NULL)
+		return;
 
-	memcpy(m, tmp, sizeof(tmp));
+	/*
+	 * Create the NormalMatrix. It's the inverse transpose of the
+	 * ModelView matrix, which for a rigid transformation like this one
+	 * is its rotation part, so the inversion is skipped.
+	 */
+	memcpy(normal_matrix, g->view_model, sizeof g->view_model);
+	rotate(normal_matrix, 2 * M_PI * angle / 360.0, 0, 0, 1);
+	normal_matrix[12] = normal_matrix[13] = normal_matrix[14] = 0.0;
+	view.skipped++;
 }
 
 /**
  * Draws a gear.
  *
- * @param gear the gear to draw
- * @param transform the current transformation matrix
- * @param x the x position to draw the gear at
- * @param y the y position to draw the gear at
+ * @param gear the mesh to draw
+ * @param g the gear to draw the mesh for
  * @param angle the rotation angle of the gear
- * @param color the color of the gear
  */
 static void
-draw_gear(struct gear *gear, GLfloat *transform,
-		GLfloat x, GLfloat y, GLfloat angle, const GLfloat color[4])
+draw_gear(struct gear *gear, struct scene_gear *g, GLfloat angle)
 {
-	GLfloat model_view[16];
 	GLfloat normal_matrix[16];
 	GLfloat model_view_projection[16];
+	uint64_t t = trace_begin();
 
-	/* Translate and rotate the gear */
-	memcpy(model_view, transform, sizeof (model_view));
-	translate(model_view, x, y, 0);
-	rotate(model_view, 2 * M_PI * angle / 360.0, 0, 0, 1);
-
-	/* Create and set the ModelViewProjectionMatrix */
-	memcpy(model_view_projection, ProjectionMatrix, sizeof(model_view_projection));
-	multiply(model_view_projection, model_view);
-
+	/* Set the ModelViewProjectionMatrix and the NormalMatrix */
+	gear_matrices(g, angle, model_view_projection, normal_matrix);
 	glUniformMatrix4fv(ModelViewProjectionMatrix_location, 1, GL_FALSE,
 							 model_view_projection);
-
-	/*
-	 * Create and set the NormalMatrix. It's the inverse transpose of the
-	 * ModelView matrix.
-	 */
-	memcpy(normal_matrix, model_view, sizeof (normal_matrix));
-	invert(normal_matrix);
-	transpose(normal_matrix);
 	glUniformMatrix4fv(NormalMatrix_location, 1, GL_FALSE, normal_matrix);
 
 	/* Set the gear color */
-	glUniform4fv(MaterialColor_location, 1, color);
+	glUniform4fv(MaterialColor_location, 1, g->color);
 
-	/* Set the vertex buffer object to use */
-	glBindBuffer(GL_ARRAY_BUFFER, gear->vbo);
+	draw_strips(gear);
 
-	/* Set up the position of the attributes in the vertex buffer object */
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-			6 * sizeof(GLfloat), NULL);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-			6 * sizeof(GLfloat), (GLfloat *) 0 + 3);
+	trace_end("draw_gear", t);
+}
 
-	/* Enable the attributes */
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+/**
+ * Draws a gear into the depth buffer only.
+ *
+ * The ModelViewProjectionMatrix is computed by gear_matrices() as in
+ * draw_gear() so that both passes produce identical depth values.
+ *
+ * @param gear the mesh to draw
+ * @param g the gear to draw the mesh for
+ * @param angle the rotation angle of the gear
+ */
+static void
+draw_gear_depth(struct gear *gear, struct scene_gear *g, GLfloat angle)
+{
+	GLfloat model_view_projection[16];
 
-	/* Draw the triangle strips that comprise the gear */
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, gear->nvertices);
+	gear_matrices(g, angle, model_view_projection, NULL);
+	glUniformMatrix4fv(DepthModelViewProjectionMatrix_location, 1, GL_FALSE,
+							 model_view_projection);
 
-	/* Disable the attributes */
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(0);
+	draw_strips(gear);
 }
 
+/*
+ * The gear shaders are specialized by create_shader(), which prepends
+ * definitions of PER_PIXEL, NUM_LIGHTS and ALU_LOOPS to the source.
+ */
 static const char vertex_shader[] =
 "attribute vec3 position;\n"
 "attribute vec3 normal;\n"
 "\n"
 "uniform mat4 ModelViewProjectionMatrix;\n"
 "uniform mat4 NormalMatrix;\n"
-"uniform vec4 LightSourcePosition;\n"
-"uniform vec4 MaterialColor;\n"
+"uniform mediump vec4 LightSourcePosition[NUM_LIGHTS];\n"
+"uniform mediump vec4 MaterialColor;\n"
 "\n"
+"#if PER_PIXEL\n"
+"varying vec3 Normal;\n"
+"#else\n"
 "varying vec4 Color;\n"
+"#endif\n"
+"\n"
+"invariant gl_Position;\n"
 "\n"
 "void main(void)\n"
 "{\n"
 "	 // Transform the normal to eye coordinates\n"
 "	 vec3 N = normalize(vec3(NormalMatrix * vec4(normal, 1.0)));\n"
 "\n"
-"	 // The LightSourcePosition is actually its direction for directional light\n"
-"	 vec3 L = normalize(LightSourcePosition.xyz);\n"
-"\n"
-"	 float diffuse = max(dot(N, L), 0.0);\n"
+"#if PER_PIXEL\n"
+"	 Normal = N;\n"
+"#else\n"
+"	 float diffuse = 0.0;\n"
+"	 for (int i = 0; i < NUM_LIGHTS; i++) {\n"
+"		 // The LightSourcePosition is actually its direction for directional light\n"
+"		 vec3 L = normalize(LightSourcePosition[i].xyz);\n"
+"		 diffuse += max(dot(N, L), 0.0);\n"
+"	 }\n"
 "	 float ambient = 0.2;\n"
 "\n"
 "	 // Multiply the diffuse value by the vertex color (which is fixed in this case)\n"
 "	 // to get the actual color that we will use to draw this vertex with\n"
-"	 Color = vec4((ambient + diffuse) * MaterialColor.xyz, 1.0);\n"
+"	 Color = vec4((ambient + diffuse / float(NUM_LIGHTS)) * MaterialColor.xyz, 1.0);\n"
+"#endif\n"
 "\n"
 "	 // Transform the position to clip coordinates\n"
 "	 gl_Position = ModelViewProjectionMatrix * vec4(position, 1.0);\n"
@@ -618,11 +961,63 @@ static const char vertex_shader[] =
 
 static const char fragment_shader[] =
 "precision mediump float;\n"
+"\n"
+"#if PER_PIXEL\n"
+"uniform vec4 LightSourcePosition[NUM_LIGHTS];\n"
+"uniform vec4 MaterialColor;\n"
+"\n"
+"varying vec3 Normal;\n"
+"#else\n"
 "varying vec4 Color;\n"
+"#endif\n"
 "\n"
 "void main(void)\n"
 "{\n"
-"	 gl_FragColor = Color;\n"
+"#if PER_PIXEL\n"
+"	 // Blinn-Phong with the viewer along the z axis\n"
+"	 vec3 N = normalize(Normal);\n"
+"	 float diffuse = 0.0, specular = 0.0;\n"
+"	 for (int i = 0; i < NUM_LIGHTS; i++) {\n"
+"		 vec3 L = normalize(LightSourcePosition[i].xyz);\n"
+"		 vec3 H = normalize(L + vec3(0.0, 0.0, 1.0));\n"
+"		 diffuse += max(dot(N, L), 0.0);\n"
+"		 specular += pow(max(dot(N, H), 0.0), 32.0);\n"
+"	 }\n"
+"	 vec4 color = vec4((0.2 + diffuse / float(NUM_LIGHTS)) * MaterialColor.xyz +\n"
+"			   0.5 * specular / float(NUM_LIGHTS), 1.0);\n"
+"#else\n"
+"	 vec4 color = Color;\n"
+"#endif\n"
+"\n"
+"#if ALU_LOOPS > 0\n"
+"	 // Burn ALU cycles without visibly changing the color\n"
+"	 float k = color.x;\n"
+"	 for (int i = 0; i < ALU_LOOPS; i++)\n"
+"		 k = fract(sin(k) * 43.7585);\n"
+"	 color.rgb += k * 0.001;\n"
+"#endif\n"
+"\n"
+"	 gl_FragColor = color;\n"
+"}";
+
+static const char depth_vertex_shader[] =
+"attribute vec3 position;\n"
+"\n"
+"uniform mat4 ModelViewProjectionMatrix;\n"
+"\n"
+"invariant gl_Position;\n"
+"\n"
+"void main(void)\n"
+"{\n"
+"	 gl_Position = ModelViewProjectionMatrix * vec4(position, 1.0);\n"
+"}";
+
+static const char depth_fragment_shader[] =
+"precision mediump float;\n"
+"\n"
+"void main(void)\n"
+"{\n"
+"	 gl_FragColor = vec4(0.0);\n"
 "}";
 
 static bool check_egl_ext(const char *exts, const char *ext) {
@@ -741,6 +1136,15 @@ init_egl(struct display *display, struct window *window)
 	if (display->swap_buffers_with_damage)
 		printf("has EGL_EXT_buffer_age and %s\n", swap_damage_ext_to_entrypoint[i].extension);
 
+	if (extensions && check_egl_ext(extensions, "EGL_KHR_fence_sync")) {
+		display->egl.create_sync = (PFNEGLCREATESYNCKHRPROC)
+			eglGetProcAddress("eglCreateSyncKHR");
+		display->egl.client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)
+			eglGetProcAddress("eglClientWaitSyncKHR");
+		display->egl.destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)
+			eglGetProcAddress("eglDestroySyncKHR");
+	}
+
 }
 
 static void
@@ -756,10 +1160,21 @@ create_shader(struct window *window, const char *source, GLenum shader_type)
 	GLuint shader;
 	GLint status;
 
+	const char *sources[2];
+	char defines[128];
+
 	shader = glCreateShader(shader_type);
 	assert(shader != 0);
 
-	glShaderSource(shader, 1, (const char **) &source, NULL);
+	snprintf(defines, sizeof defines,
+		 "#define PER_PIXEL %d\n"
+		 "#define NUM_LIGHTS %d\n"
+		 "#define ALU_LOOPS %d\n",
+		 window->per_pixel, window->lights, window->alu_loops);
+	sources[0] = defines;
+	sources[1] = source;
+
+	glShaderSource(shader, 2, sources, NULL);
 	glCompileShader(shader);
 
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
@@ -776,34 +1191,205 @@ create_shader(struct window *window, const char *source, GLenum shader_type)
 	return shader;
 }
 
-static void
-init_gl(struct window *window)
+/**
+ * Selects the level of detail of a gear from its projected size.
+ *
+ * @param window the window the gear is drawn in
+ * @param gear the gear to select the mesh of
+ * @param transform the current transformation matrix
+ *
+ * @return the mesh to draw
+ */
+static struct gear *
+select_lod(struct window *window, const struct scene_gear *gear,
+	   const GLfloat *transform)
 {
-	GLuint frag, vert;
-	GLuint program;
-	GLint status;
+	GLfloat depth, pixels;
+
+	/* The depth of the gear center in eye coordinates */
+	depth = -(transform[2] * gear->x + transform[6] * gear->y + transform[14]);
+	if (depth <= 0)
+		return gear->lod[0];
+
+	pixels = gear->lod[0]->radius * ProjectionMatrix[5] *
+		 window->dynres.height / 2.0 / depth;
+
+	if (pixels >= GEAR_LOD1_PIXELS)
+		return gear->lod[0];
+	else if (pixels >= GEAR_LOD2_PIXELS)
+		return gear->lod[1];
+	else
+		return gear->lod[2];
+}
 
-	frag = create_shader(window, fragment_shader, GL_FRAGMENT_SHADER);
-	vert = create_shader(window, vertex_shader, GL_VERTEX_SHADER);
+/**
+ * Returns the distance from the origin that a gear train reaches out to.
+ *
+ * @param train the gears of the train
+ * @param count the number of gears
+ */
+static GLfloat
+train_radius(const struct scene_entry *train, int count)
+{
+	GLfloat radius = 0.0;
+	int i;
 
-	program = glCreateProgram();
-	glAttachShader(program, frag);
-	glAttachShader(program, vert);
-	glLinkProgram(program);
+	for (i = 0; i < count; i++)
+		radius = fmax(radius, hypotf(train[i].x, train[i].y) +
+				      train[i].params.outer_radius +
+				      train[i].params.tooth_depth / 2.0);
 
-	glGetProgramiv(program, GL_LINK_STATUS, &status);
-	if (!status) {
-		char log[1000];
-		GLsizei len;
-		glGetProgramInfoLog(program, 1000, &len, log);
-		fprintf(stderr, "Error: linking:\n%.*s\n", len, log);
-		exit(1);
+	return radius;
+}
+
+/**
+ * Creates the gears of the scene.
+ *
+ * The gear train, the classic three gears or the one of the scene file,
+ * is replicated over a grid x grid square. Gears with the same parameters
+ * share their meshes through the mesh cache.
+ *
+ * @param window the window to create the scene for
+ */
+static void
+init_scene(struct window *window)
+{
+	const struct scene_entry *train = classic_train;
+	struct scene_entry *loaded = NULL;
+	int count = classic_train_count;
+	int grid = window->grid > 0 ? window->grid : 1;
+	int i, j, k, lod;
+	struct scene_gear *g;
+	GLfloat scale, spacing;
+
+	if (window->scene_path) {
+		loaded = scene_load(window->scene_path, &count);
+		if (!loaded)
+			exit(EXIT_FAILURE);
+		train = loaded;
 	}
 
-	glUseProgram(program);
+	mesh_cache = mesh_cache_create();
+	assert(mesh_cache);
+#ifdef HAVE_BAKED_MESHES
+	mesh_cache_set_baked(mesh_cache, baked_meshes, baked_mesh_count);
+#endif
 
-	window->gl.pos = 0;
-	window->gl.col = 1;
+	scene_count = grid * grid * count;
+	scene = calloc(scene_count, sizeof *scene);
+	draw_list = calloc(scene_count, sizeof *draw_list);
+	assert(scene && draw_list);
+
+	/* Trains larger than the classic one are spaced and viewed further out */
+	scale = fmax(1.0, train_radius(train, count) /
+			  train_radius(classic_train, classic_train_count));
+	spacing = GRID_SPACING * scale;
+
+	g = scene;
+	for (i = 0; i < grid; i++) {
+		for (j = 0; j < grid; j++) {
+			for (k = 0; k < count; k++, g++) {
+				for (lod = 0; lod < GEAR_LOD_COUNT; lod++) {
+					g->lod[lod] = mesh_cache_get(mesh_cache,
+								     &train[k].params, lod,
+								     lod == 0 ? &g->mesh : NULL,
+								     NULL);
+					assert(g->lod[lod]);
+				}
+				g->x = train[k].x + (i - (grid - 1) / 2.0) * spacing;
+				g->y = train[k].y + (j - (grid - 1) / 2.0) * spacing;
+				g->ratio = train[k].ratio;
+				g->phase = train[k].phase;
+				memcpy(g->color, train[k].color, sizeof g->color);
+			}
+		}
+	}
+	free(loaded);
+
+	if (window->backend == BACKEND_GL)
+		upload_meshes(window, mesh_cache);
+
+	if (window->update_threads > 0 && window->backend != BACKEND_VULKAN) {
+		scene_state = scene_state_create(scene_count);
+		update_pool = pool_create(window->update_threads);
+		assert(scene_state && update_pool);
+		for (i = 0; i < scene_count; i++) {
+			scene_state->x[i] = scene[i].x;
+			scene_state->y[i] = scene[i].y;
+			scene_state->ratio[i] = scene[i].ratio;
+			scene_state->phase[i] = scene[i].phase;
+		}
+	}
+
+	if (window->scene_path)
+		printf("scene: %d gears sharing %d meshes\n", scene_count,
+		       mesh_cache_count(mesh_cache));
+
+	/* Move the camera back so that the whole grid stays in view */
+	view_distance = 40.0 * grid * scale;
+}
+
+static void
+link_program(GLuint program)
+{
+	GLint status;
+
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		char log[1000];
+		GLsizei len;
+		glGetProgramInfoLog(program, 1000, &len, log);
+		fprintf(stderr, "Error: linking:\n%.*s\n", len, log);
+		exit(1);
+	}
+}
+
+static void
+init_gl(struct window *window)
+{
+	GLfloat lights[MAX_LIGHTS][4];
+	GLuint frag, vert;
+	GLuint program;
+	int i;
+
+	if (window->display->egl.create_sync) {
+		window->pipeline.fences = calloc(window->frames_in_flight,
+						 sizeof(*window->pipeline.fences));
+		assert(window->pipeline.fences);
+	} else {
+		printf("no EGL_KHR_fence_sync, the frames in flight are not limited\n");
+	}
+
+	if (window->depth_prepass) {
+		frag = create_shader(window, depth_fragment_shader, GL_FRAGMENT_SHADER);
+		vert = create_shader(window, depth_vertex_shader, GL_VERTEX_SHADER);
+
+		program = glCreateProgram();
+		glAttachShader(program, frag);
+		glAttachShader(program, vert);
+		glBindAttribLocation(program, 0, "position");
+		link_program(program);
+
+		DepthModelViewProjectionMatrix_location =
+			glGetUniformLocation(program, "ModelViewProjectionMatrix");
+		window->gl.depth_program = program;
+	}
+
+	frag = create_shader(window, fragment_shader, GL_FRAGMENT_SHADER);
+	vert = create_shader(window, vertex_shader, GL_VERTEX_SHADER);
+
+	program = glCreateProgram();
+	glAttachShader(program, frag);
+	glAttachShader(program, vert);
+	link_program(program);
+
+	glUseProgram(program);
+	window->gl.program = program;
+
+	window->gl.pos = 0;
+	window->gl.col = 1;
 
 	glBindAttribLocation(program, window->gl.pos, "pos");
 	glBindAttribLocation(program, window->gl.col, "normal");
@@ -818,16 +1404,274 @@ init_gl(struct window *window)
 	LightSourcePosition_location = glGetUniformLocation(program, "LightSourcePosition");
 	MaterialColor_location = glGetUniformLocation(program, "MaterialColor");
 
-	/* Set the LightSourcePosition uniform which is constant throught the program */
-	glUniform4fv(LightSourcePosition_location, 1, LightSourcePosition);
+	/*
+	 * Set the LightSourcePosition uniform which is constant throught the
+	 * program. Additional lights are spread evenly around the z axis.
+	 */
+	for (i = 0; i < window->lights; i++) {
+		double s, c;
+
+		sincos(2.0 * M_PI * i / window->lights, &s, &c);
+		lights[i][0] = LightSourcePosition[0] * c - LightSourcePosition[1] * s;
+		lights[i][1] = LightSourcePosition[0] * s + LightSourcePosition[1] * c;
+		lights[i][2] = LightSourcePosition[2];
+		lights[i][3] = LightSourcePosition[3];
+	}
+	glUniform4fv(LightSourcePosition_location, window->lights, &lights[0][0]);
+
+	if (window->per_pixel || window->lights > 1 || window->alu_loops)
+		printf("shading: per-%s, %d lights, %d ALU loops\n",
+		       window->per_pixel ? "pixel" : "vertex",
+		       window->lights, window->alu_loops);
 
-	/* make the gears */
-	gear1 = create_gear(1.0, 4.0, 1.0, 20, 0.7);
-	gear2 = create_gear(0.5, 2.0, 2.0, 10, 0.7);
-	gear3 = create_gear(1.3, 2.0, 0.5, 10, 0.7);
+	init_scene(window);
+
+	if (window->occlusion &&
+	    !epoxy_has_gl_extension("GL_EXT_occlusion_query_boolean")) {
+		fprintf(stderr, "GL_EXT_occlusion_query_boolean not supported, "
+			"occlusion queries disabled\n");
+		window->occlusion = 0;
+	}
+	if (window->occlusion) {
+		for (i = 0; i < scene_count; i++)
+			glGenQueriesEXT(1, &scene[i].query);
+	}
 
 	glEnable(GL_CULL_FACE);
 	glEnable(GL_DEPTH_TEST);
+
+	printf("renderer: %s\n", (const char *) glGetString(GL_RENDERER));
+}
+
+static void
+init_cpu(struct window *window)
+{
+	if (!window->display->shm) {
+		fprintf(stderr, "compositor lacks wl_shm\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (window->occlusion || window->depth_prepass || window->per_pixel ||
+	    window->lights > 1 || window->alu_loops)
+		fprintf(stderr, "GL only options ignored by the CPU renderer\n");
+	window->occlusion = 0;
+	window->depth_prepass = 0;
+
+	init_scene(window);
+
+	window->swrast = swrast_create(window->threads);
+	assert(window->swrast);
+
+	printf("renderer: CPU rasterizer, %d threads\n", window->threads);
+}
+
+#ifdef HAVE_VULKAN
+/**
+ * Creates the Vulkan renderer and hands it the whole scene.
+ *
+ * The command buffers are recorded once, so the per-frame culling and
+ * ordering options of the GL renderer do not apply.
+ */
+static void
+init_vulkan(struct window *window)
+{
+	struct vkrender_mesh *meshes;
+	struct vkrender_gear *gears;
+	int *mesh_map;
+	int i, nmeshes = 0;
+
+	if (window->lod || window->cull || window->occlusion || window->sort ||
+	    window->depth_prepass || window->per_pixel || window->lights > 1 ||
+	    window->alu_loops)
+		fprintf(stderr, "GL only options ignored by the Vulkan renderer\n");
+	window->lod = 0;
+	window->cull = 0;
+	window->occlusion = 0;
+	window->sort = 0;
+	window->depth_prepass = 0;
+
+	window->vk = vkrender_create(window->display->display, window->surface,
+				     window->frame_sync,
+				     window->opaque || window->fullscreen,
+				     window->frames_in_flight);
+	if (!window->vk) {
+		fprintf(stderr, "failed to initialize Vulkan\n");
+		exit(EXIT_FAILURE);
+	}
+
+	init_scene(window);
+
+	/* Only the finest meshes of the cache are uploaded */
+	meshes = calloc(mesh_cache_count(mesh_cache), sizeof *meshes);
+	gears = calloc(scene_count, sizeof *gears);
+	mesh_map = malloc(mesh_cache_count(mesh_cache) * sizeof *mesh_map);
+	assert(meshes && gears && mesh_map);
+	memset(mesh_map, -1, mesh_cache_count(mesh_cache) * sizeof *mesh_map);
+
+	for (i = 0; i < scene_count; i++) {
+		struct scene_gear *g = &scene[i];
+
+		if (mesh_map[g->mesh] < 0) {
+			mesh_map[g->mesh] = nmeshes;
+			meshes[nmeshes].vertices = &g->lod[0]->vertices[0][0];
+			meshes[nmeshes].count = g->lod[0]->nvertices;
+			window->mesh_gpu_bytes += g->lod[0]->nvertices *
+						  sizeof(GearVertex);
+			nmeshes++;
+		}
+
+		gears[i].mesh = mesh_map[g->mesh];
+		gears[i].x = g->x;
+		gears[i].y = g->y;
+		gears[i].ratio = g->ratio;
+		gears[i].phase = g->phase;
+		memcpy(gears[i].color, g->color, sizeof gears[i].color);
+	}
+
+	if (!vkrender_set_scene(window->vk, meshes, nmeshes, gears, scene_count)) {
+		fprintf(stderr, "failed to upload the scene\n");
+		exit(EXIT_FAILURE);
+	}
+	free(meshes);
+	free(gears);
+	free(mesh_map);
+
+	if (!window->keep_meshes)
+		for (i = 0; i < mesh_cache_count(mesh_cache); i++)
+			gear_free_vertices(mesh_cache_mesh(mesh_cache, i));
+
+	printf("renderer: Vulkan, %s\n", vkrender_device_name(window->vk));
+}
+#endif
+
+/**
+ * Prints the peak memory use of the process and the memory of the meshes.
+ *
+ * @param window the window drawing the scene
+ */
+static void
+print_memory(struct window *window)
+{
+	size_t cpu = mesh_cache_bytes(mesh_cache);
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	printf("memory: peak RSS %ld KiB, meshes %zu KiB CPU and %zu KiB GPU, "
+	       "%.0f and %.0f bytes per gear\n", usage.ru_maxrss, cpu / 1024,
+	       window->mesh_gpu_bytes / 1024, (double) cpu / scene_count,
+	       (double) window->mesh_gpu_bytes / scene_count);
+}
+
+/**
+ * Frees the scene and its meshes.
+ *
+ * @param window the window drawing the scene
+ */
+static void
+fini_scene(struct window *window)
+{
+	int i;
+
+	if (window->backend == BACKEND_GL) {
+		if (window->occlusion)
+			for (i = 0; i < scene_count; i++)
+				glDeleteQueriesEXT(1, &scene[i].query);
+		glDeleteBuffers(1, &arena.vbo);
+	}
+
+	if (scene_state) {
+		pool_destroy(update_pool);
+		scene_state_destroy(scene_state);
+	}
+
+	mesh_cache_destroy(mesh_cache);
+	free(scene);
+	free(draw_list);
+}
+
+/**
+ * Resizes the EGL window to the render resolution.
+ *
+ * The render resolution is the window geometry times the dynamic resolution
+ * scale. The viewport scales the buffer back up to the window geometry.
+ *
+ * @param window the window to resize
+ */
+static void
+update_render_size(struct window *window)
+{
+	int width = window->geometry.width * window->dynres.scale + 0.5;
+	int height = window->geometry.height * window->dynres.scale + 0.5;
+
+	window->dynres.width = width > 0 ? width : 1;
+	window->dynres.height = height > 0 ? height : 1;
+
+	if (window->native)
+		wl_egl_window_resize(window->native,
+					  window->dynres.width,
+					  window->dynres.height, 0, 0);
+	if (window->viewport)
+		wp_viewport_set_destination(window->viewport,
+					    window->geometry.width,
+					    window->geometry.height);
+
+#ifdef HAVE_VULKAN
+	if (window->vk)
+		vkrender_resize(window->vk, window->dynres.width,
+				window->dynres.height);
+#endif
+
+	/* Set the viewport */
+	if (window->backend == BACKEND_GL)
+		glViewport(0, 0, (GLint) window->dynres.width, (GLint) window->dynres.height);
+}
+
+/**
+ * Moves the render resolution towards the target frame time.
+ *
+ * Called once per frame. The frame time is smoothed and every
+ * DYNRES_INTERVAL frames the scale is stepped by the square root of the
+ * budget ratio, since the fill cost grows with the pixel count.
+ *
+ * @param window the window to update
+ */
+static void
+update_dynamic_resolution(struct window *window)
+{
+	double now = get_time_ms();
+	double frame_time, scale, target = window->dynres.target;
+
+	if (window->dynres.last == 0.0) {
+		window->dynres.last = now;
+		return;
+	}
+
+	frame_time = now - window->dynres.last;
+	window->dynres.last = now;
+
+	if (frame_time > target)
+		window->dynres.over_budget += frame_time - target;
+
+	if (window->dynres.avg == 0.0)
+		window->dynres.avg = frame_time;
+	else
+		window->dynres.avg += 0.1 * (frame_time - window->dynres.avg);
+
+	if (++window->dynres.frames < DYNRES_INTERVAL)
+		return;
+	window->dynres.frames = 0;
+
+	scale = window->dynres.scale;
+	if (window->dynres.avg > target * 1.05)
+		scale *= fmax(sqrt(target / window->dynres.avg), 0.8);
+	else if (window->dynres.avg < target * 0.85)
+		scale *= fmin(sqrt(target / window->dynres.avg), 1.1);
+	scale = fmin(fmax(scale, DYNRES_MIN_SCALE), 1.0);
+
+	if (fabs(scale - window->dynres.scale) > 0.01) {
+		window->dynres.scale = scale;
+		update_render_size(window);
+	}
 }
 
 static void
@@ -835,10 +1679,13 @@ handle_surface_configure(void *data, struct xdg_surface *surface,
 			 uint32_t serial)
 {
 	struct window *window = data;
+	uint64_t t = trace_begin();
 
 	xdg_surface_ack_configure(surface, serial);
 
 	window->wait_for_configure = false;
+
+	trace_end("surface configure", t);
 }
 
 static const struct xdg_surface_listener xdg_surface_listener = {
@@ -852,9 +1699,11 @@ handle_toplevel_configure(void *data, struct xdg_toplevel *toplevel,
 {
 	struct window *window = data;
 	uint32_t *p;
+	uint64_t t = trace_begin();
 
 	window->fullscreen = 0;
 	window->maximized = 0;
+	window->suspended = false;
 	wl_array_for_each(p, states) {
 		uint32_t state = *p;
 		switch (state) {
@@ -864,6 +1713,11 @@ handle_toplevel_configure(void *data, struct xdg_toplevel *toplevel,
 		case XDG_TOPLEVEL_STATE_MAXIMIZED:
 			window->maximized = 1;
 			break;
+#ifdef XDG_TOPLEVEL_STATE_SUSPENDED_SINCE_VERSION
+		case XDG_TOPLEVEL_STATE_SUSPENDED:
+			window->suspended = true;
+			break;
+#endif
 		}
 	}
 
@@ -878,108 +1732,1020 @@ handle_toplevel_configure(void *data, struct xdg_toplevel *toplevel,
 		window->geometry = window->window_size;
 	}
 
-	if (window->native)
-		wl_egl_window_resize(window->native,
-					  window->geometry.width,
-					  window->geometry.height, 0, 0);
-	/* Update the projection matrix */
-	GLfloat h = (GLfloat)window->geometry.height / (GLfloat)window->geometry.width;
-	frustum(ProjectionMatrix, -1.0, 1.0, -h, h, 5.0, 60.0);
+	update_render_size(window);
+
+	/* Update the projection matrix */
+	GLfloat h = (GLfloat)window->geometry.height / (GLfloat)window->geometry.width;
+	frustum(ProjectionMatrix, -1.0, 1.0, -h, h, 5.0, 1.5 * view_distance);
+	invalidate_view();
+
+	trace_end("toplevel configure", t);
+}
+
+static void
+handle_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel)
+{
+	running = 0;
+}
+
+static void
+handle_toplevel_configure_bounds (void *data, struct xdg_toplevel *xdg_toplevel,
+                                  int32_t width, int32_t height)
+{
+}
+
+static void handle_wm_capabilities (void *data, struct xdg_toplevel *xdg_toplevel,
+                                    struct wl_array *capabilities)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+	handle_toplevel_configure,
+	handle_toplevel_close,
+	handle_toplevel_configure_bounds,
+	handle_wm_capabilities,
+};
+
+static void
+create_surface(struct window *window)
+{
+	struct display *display = window->display;
+	EGLBoolean ret;
+
+	window->surface = wl_compositor_create_surface(display->compositor);
+
+	if (window->backend == BACKEND_GL) {
+		window->native =
+			wl_egl_window_create(window->surface,
+						  window->geometry.width,
+						  window->geometry.height);
+		window->egl_surface =
+			eglCreatePlatformWindowSurface(display->egl.dpy,
+								display->egl.conf,
+								window->native, NULL);
+	}
+
+	window->xdg_surface = xdg_wm_base_get_xdg_surface(display->wm_base,
+							  window->surface);
+	xdg_surface_add_listener(window->xdg_surface,
+				 &xdg_surface_listener, window);
+
+	window->xdg_toplevel =
+		xdg_surface_get_toplevel(window->xdg_surface);
+	xdg_toplevel_add_listener(window->xdg_toplevel,
+				  &xdg_toplevel_listener, window);
+
+	xdg_toplevel_set_title(window->xdg_toplevel, "Wayland Gears");
+
+	if (window->dynres.target > 0 && !display->viewporter) {
+		fprintf(stderr, "compositor lacks wp_viewporter, "
+			"dynamic resolution disabled\n");
+		window->dynres.target = 0;
+	}
+	if (window->dynres.target > 0)
+		window->viewport = wp_viewporter_get_viewport(display->viewporter,
+							      window->surface);
+
+	window->wait_for_configure = true;
+	wl_surface_commit(window->surface);
+
+	if (window->backend == BACKEND_GL) {
+		ret = eglMakeCurrent(window->display->egl.dpy, window->egl_surface,
+					  window->egl_surface, window->display->egl.ctx);
+		assert(ret == EGL_TRUE);
+
+		if (!window->frame_sync)
+			eglSwapInterval(display->egl.dpy, 0);
+	}
+
+	if (!display->wm_base)
+		return;
+
+	if (window->fullscreen)
+		xdg_toplevel_set_fullscreen(window->xdg_toplevel, NULL);
+}
+
+static void
+destroy_shm_buffer(struct shm_buffer *buffer)
+{
+	if (!buffer->buffer)
+		return;
+
+	wl_buffer_destroy(buffer->buffer);
+	munmap(buffer->data, buffer->size);
+	buffer->buffer = NULL;
+}
+
+static void
+destroy_surface(struct window *window)
+{
+	int i;
+
+	if (window->backend == BACKEND_GL) {
+		if (window->pipeline.fences) {
+			for (i = 0; i < window->frames_in_flight; i++)
+				if (window->pipeline.fences[i] != EGL_NO_SYNC_KHR)
+					window->display->egl.destroy_sync(
+						window->display->egl.dpy,
+						window->pipeline.fences[i]);
+			free(window->pipeline.fences);
+		}
+
+		/* Required, otherwise segfault in egl_dri2.c: dri2_make_current()
+		 * on eglReleaseThread(). */
+		eglMakeCurrent(window->display->egl.dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
+					 EGL_NO_CONTEXT);
+
+		eglDestroySurface(window->display->egl.dpy,
+							 window->egl_surface);
+		wl_egl_window_destroy(window->native);
+	}
+
+	for (i = 0; i < SHM_BUFFER_COUNT; i++)
+		destroy_shm_buffer(&window->shm_buffers[i]);
+
+	if (window->viewport)
+		wp_viewport_destroy(window->viewport);
+	if (window->xdg_toplevel)
+		xdg_toplevel_destroy(window->xdg_toplevel);
+	if (window->xdg_surface)
+		xdg_surface_destroy(window->xdg_surface);
+	wl_surface_destroy(window->surface);
+
+	if (window->callback)
+		wl_callback_destroy(window->callback);
+}
+
+/**
+ * Extracts the planes of the view frustum from a clip transformation.
+ *
+ * @param planes the normalized planes (a, b, c, d) to fill
+ * @param m the combined projection and view matrix
+ */
+static void
+frustum_planes(GLfloat planes[6][4], const GLfloat *m)
+{
+	GLfloat len;
+	int i, j;
+
+	/* left/right, bottom/top, near/far are the 4th row +/- rows 1-3 */
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 4; j++) {
+			planes[2 * i][j] = m[j * 4 + 3] + m[j * 4 + i];
+			planes[2 * i + 1][j] = m[j * 4 + 3] - m[j * 4 + i];
+		}
+	}
+
+	for (i = 0; i < 6; i++) {
+		len = sqrt(planes[i][0] * planes[i][0] +
+			   planes[i][1] * planes[i][1] +
+			   planes[i][2] * planes[i][2]);
+		for (j = 0; j < 4; j++)
+			planes[i][j] /= len;
+	}
+}
+
+/**
+ * Checks whether a sphere lies completely outside of the view frustum.
+ *
+ * @param planes the frustum planes
+ * @param x the x coordinate of the sphere center
+ * @param y the y coordinate of the sphere center
+ * @param z the z coordinate of the sphere center
+ * @param radius the radius of the sphere
+ */
+static bool
+sphere_outside(GLfloat planes[6][4], GLfloat x, GLfloat y, GLfloat z,
+	       GLfloat radius)
+{
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		if (planes[i][0] * x + planes[i][1] * y + planes[i][2] * z +
+		    planes[i][3] < -radius)
+			return true;
+	}
+
+	return false;
+}
+
+static int
+compare_draw_items(const void *a, const void *b)
+{
+	const struct draw_item *ia = a, *ib = b;
+
+	return (ia->depth > ib->depth) - (ia->depth < ib->depth);
+}
+
+/**
+ * Fills the draw list with the gears to draw in this frame.
+ *
+ * Gears outside of the view frustum are skipped when culling is enabled,
+ * and the results of last frame's occlusion queries are collected. The
+ * remaining gears are optionally sorted front to back.
+ *
+ * @param window the window to draw in
+ * @param transform the current transformation matrix
+ *
+ * @return the number of gears in the draw list
+ */
+static int
+build_draw_list(struct window *window, const GLfloat *transform)
+{
+	GLfloat clip[16], (*planes)[4] = view.planes;
+	GLuint result;
+	int i, count = 0;
+
+	if (window->cull && view.planes_serial != view.serial) {
+		memcpy(clip, ProjectionMatrix, sizeof(clip));
+		multiply(clip, transform);
+		frustum_planes(view.planes, clip);
+		view.planes_serial = view.serial;
+		view.computed++;
+	} else if (window->cull) {
+		view.skipped++;
+	}
+
+	for (i = 0; i < scene_count; i++) {
+		struct scene_gear *g = &scene[i];
+		struct draw_item *item;
+
+		if (window->cull &&
+		    sphere_outside(planes, g->x, g->y, 0, g->lod[0]->radius)) {
+			window->culled++;
+			continue;
+		}
+
+		if (window->occlusion && g->query_pending) {
+			glGetQueryObjectuivEXT(g->query,
+					       GL_QUERY_RESULT_AVAILABLE_EXT,
+					       &result);
+			if (result) {
+				glGetQueryObjectuivEXT(g->query,
+						       GL_QUERY_RESULT_EXT,
+						       &result);
+				g->occluded = !result;
+				g->query_pending = false;
+			}
+		}
+
+		item = &draw_list[count++];
+		item->gear = g;
+		item->mesh = window->lod ? select_lod(window, g, transform) : g->lod[0];
+		item->depth = -(transform[2] * g->x + transform[6] * g->y +
+				transform[14]);
+	}
+
+	if (window->sort)
+		qsort(draw_list, count, sizeof(*draw_list), compare_draw_items);
+
+	return count;
+}
+
+/**
+ * Draws the gears of the scene with GL.
+ *
+ * With occlusion queries, every drawn gear is wrapped in a query whose
+ * result is read one frame later; gears found hidden only draw their
+ * coarsest mesh into the depth test until a query reports them visible.
+ *
+ * The depth-only prepass lays down the depth of the scene first, so that
+ * the shading pass only runs the fragment shader for the visible surface.
+ *
+ * @param window the window to draw in
+ * @param transform the current transformation matrix
+ */
+static void
+draw_scene(struct window *window, GLfloat *transform)
+{
+	int i, count = build_draw_list(window, transform);
+	bool query;
+
+	bind_meshes();
+
+	if (window->depth_prepass) {
+		glUseProgram(window->gl.depth_program);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+		for (i = 0; i < count; i++) {
+			struct scene_gear *g = draw_list[i].gear;
+
+			if (g->occluded)
+				continue;
+			draw_gear_depth(draw_list[i].mesh, g,
+					g->ratio * angle + g->phase);
+			window->prepass_draws++;
+		}
+
+		/* The shading pass only touches the nearest surface */
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_LEQUAL);
+		glUseProgram(window->gl.program);
+	}
+
+	for (i = 0; i < count; i++) {
+		struct scene_gear *g = draw_list[i].gear;
+		struct gear *gear = draw_list[i].mesh;
+		GLfloat gear_angle = g->ratio * angle + g->phase;
+
+		query = window->occlusion && !g->query_pending;
+		if (query)
+			glBeginQueryEXT(GL_ANY_SAMPLES_PASSED_EXT, g->query);
+
+		if (g->occluded) {
+			/*
+			 * Only test the gear against the depth buffer. The
+			 * mesh drawn when visible is the test, since a coarser
+			 * one can miss the teeth or the bore that show.
+			 */
+			if (query) {
+				glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+				glDepthMask(GL_FALSE);
+				draw_gear(gear, g, gear_angle);
+				glDepthMask(window->depth_prepass ? GL_FALSE : GL_TRUE);
+				glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			}
+			window->occluded++;
+		} else {
+			draw_gear(gear, g, gear_angle);
+			window->triangles += gear->nvertices - 2;
+			window->drawn++;
+		}
+
+		if (query) {
+			glEndQueryEXT(GL_ANY_SAMPLES_PASSED_EXT);
+			g->query_pending = true;
+		}
+	}
+
+	if (window->depth_prepass) {
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+
+	unbind_meshes();
+}
+
+/**
+ * Draws the gears of the scene with the CPU rasterizer.
+ *
+ * @param window the window to draw in
+ * @param transform the current transformation matrix
+ */
+static void
+draw_scene_cpu(struct window *window, GLfloat *transform)
+{
+	GLfloat model_view_projection[16], normal_matrix[16];
+	int i, count = build_draw_list(window, transform);
+
+	for (i = 0; i < count; i++) {
+		struct scene_gear *g = draw_list[i].gear;
+		struct gear *gear = draw_list[i].mesh;
+
+		gear_matrices(g, g->ratio * angle + g->phase,
+			      model_view_projection, normal_matrix);
+		if (!swrast_draw_strip(window->swrast, &gear->vertices[0][0],
+				       gear->nvertices, model_view_projection,
+				       normal_matrix, LightSourcePosition,
+				       g->color)) {
+			fprintf(stderr, "failed to allocate CPU rasterizer triangles\n");
+			running = 0;
+			return;
+		}
+		window->triangles += gear->nvertices - 2;
+		window->drawn++;
+	}
+}
+
+#ifdef HAVE_VULKAN
+/**
+ * Renders and presents the recorded scene with Vulkan.
+ *
+ * @param window the window to draw in
+ * @param transform the current transformation matrix
+ */
+static void
+draw_scene_vulkan(struct window *window, GLfloat *transform)
+{
+	int i;
+
+	if (!vkrender_draw(window->vk, ProjectionMatrix, transform,
+			   LightSourcePosition, angle)) {
+		running = 0;
+		return;
+	}
+
+	for (i = 0; i < scene_count; i++)
+		window->triangles += scene[i].lod[0]->nvertices - 2;
+	window->drawn += scene_count;
+}
+#endif
+
+static void
+shm_buffer_release(void *data, struct wl_buffer *buffer)
+{
+	struct shm_buffer *mybuf = data;
+
+	mybuf->busy = false;
+}
+
+static const struct wl_buffer_listener shm_buffer_listener = {
+	shm_buffer_release
+};
+
+static bool
+create_shm_buffer(struct window *window, struct shm_buffer *buffer,
+		  int width, int height)
+{
+	struct wl_shm_pool *pool;
+	int fd, stride = width * 4;
+
+	buffer->size = stride * height;
+
+	fd = memfd_create("wlgears-shm", MFD_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "creating a buffer file failed: %m\n");
+		return false;
+	}
+
+	if (ftruncate(fd, buffer->size) < 0) {
+		fprintf(stderr, "ftruncate failed: %m\n");
+		close(fd);
+		return false;
+	}
+
+	buffer->data = mmap(NULL, buffer->size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED, fd, 0);
+	if (buffer->data == MAP_FAILED) {
+		fprintf(stderr, "mmap failed: %m\n");
+		close(fd);
+		return false;
+	}
+
+	pool = wl_shm_create_pool(window->display->shm, fd, buffer->size);
+	buffer->buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
+						   window->opaque ?
+						   WL_SHM_FORMAT_XRGB8888 :
+						   WL_SHM_FORMAT_ARGB8888);
+	wl_buffer_add_listener(buffer->buffer, &shm_buffer_listener, buffer);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	buffer->width = width;
+	buffer->height = height;
+
+	return true;
+}
+
+/**
+ * Returns a free wl_shm buffer of the render size.
+ *
+ * Blocks until the compositor releases a buffer if all are in use.
+ *
+ * @param window the window to get a buffer for
+ *
+ * @return the buffer or NULL on failure
+ */
+static struct shm_buffer *
+next_shm_buffer(struct window *window)
+{
+	struct shm_buffer *buffer = NULL;
+	int i;
+
+	while (!buffer) {
+		for (i = 0; i < SHM_BUFFER_COUNT; i++) {
+			if (!window->shm_buffers[i].busy) {
+				buffer = &window->shm_buffers[i];
+				break;
+			}
+		}
+		if (!buffer && wait_events(window->display, -1) < 0)
+			return NULL;
+	}
+
+	if (buffer->buffer && (buffer->width != window->dynres.width ||
+			       buffer->height != window->dynres.height))
+		destroy_shm_buffer(buffer);
+
+	if (!buffer->buffer &&
+	    !create_shm_buffer(window, buffer, window->dynres.width,
+			       window->dynres.height))
+		return NULL;
+
+	return buffer;
+}
+
+static void
+frame_done(void *data, struct wl_callback *callback, uint32_t time)
+{
+	struct window *window = data;
+
+	wl_callback_destroy(callback);
+	window->callback = NULL;
+}
+
+static const struct wl_callback_listener frame_listener = {
+	frame_done
+};
+
+/**
+ * Requests a frame callback for the next commit of the window.
+ *
+ * @param window the window to request the callback for
+ */
+static void
+request_frame_callback(struct window *window)
+{
+	window->callback = wl_surface_frame(window->surface);
+	wl_callback_add_listener(window->callback, &frame_listener, window);
+	window->callback_time = get_time_ms();
+}
+
+/**
+ * Starts a CPU rendered frame.
+ *
+ * @param window the window to draw in
+ *
+ * @return the buffer to draw into or NULL on failure
+ */
+static struct shm_buffer *
+begin_cpu_frame(struct window *window)
+{
+	struct shm_buffer *buffer;
+
+	buffer = next_shm_buffer(window);
+	if (!buffer)
+		return NULL;
+
+	if (!swrast_begin(window->swrast, buffer->data, buffer->width,
+			  buffer->height, buffer->width * 4, 0)) {
+		fprintf(stderr, "failed to allocate the CPU rasterizer bins\n");
+		return NULL;
+	}
+
+	return buffer;
+}
+
+/**
+ * Finishes a CPU rendered frame and hands the buffer to the compositor.
+ *
+ * @param window the window to draw in
+ * @param buffer the buffer returned by begin_cpu_frame()
+ */
+static void
+end_cpu_frame(struct window *window, struct shm_buffer *buffer)
+{
+	swrast_end(window->swrast);
+
+	wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+	wl_surface_damage_buffer(window->surface, 0, 0,
+				 buffer->width, buffer->height);
+	wl_surface_commit(window->surface);
+	buffer->busy = true;
+
+	flush_display(window->display);
+}
+
+static double
+timeval_to_seconds(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+/**
+ * Records the time of a frame of a timed run and ends the run once the
+ * duration has passed.
+ *
+ * @param window the window that presented a frame
+ */
+static void
+record_frame_time(struct window *window)
+{
+	double now = get_time_ms();
+
+	if (window->run.start == 0.0) {
+		window->run.start = window->run.last = now;
+		getrusage(RUSAGE_SELF, &window->run.rusage);
+		return;
+	}
+
+	if (window->run.count == window->run.capacity) {
+		window->run.capacity = window->run.capacity ?
+				       window->run.capacity * 2 : 1024;
+		window->run.times = realloc(window->run.times,
+					    window->run.capacity *
+					    sizeof(*window->run.times));
+		assert(window->run.times);
+	}
+
+	window->run.times[window->run.count++] = now - window->run.last;
+	window->run.last = now;
+
+	if (now - window->run.start >= window->run.duration * 1000.0)
+		running = 0;
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+	const double *da = a, *db = b;
+
+	return (*da > *db) - (*da < *db);
+}
+
+/**
+ * Returns the nearest-rank percentile of sorted values.
+ */
+static double
+percentile(const double *sorted, int count, double p)
+{
+	int rank = ceil(p / 100.0 * count);
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Prints the frame rate and frame time distribution of a timed run.
+ *
+ * @param window the window of the run
+ */
+static void
+print_run_summary(struct window *window)
+{
+	double *times = window->run.times;
+	int count = window->run.count;
+	double seconds, cpu, sum = 0.0;
+	struct rusage usage;
+	int i;
+
+	if (count == 0)
+		return;
+
+	qsort(times, count, sizeof(*times), compare_doubles);
+	for (i = 0; i < count; i++)
+		sum += times[i];
+	seconds = (window->run.last - window->run.start) / 1000.0;
+
+	printf("summary: %d frames in %.2f seconds = %.3f FPS\n",
+	       count, seconds, count / seconds);
+	printf("frame time: mean %.3f ms, p50 %.3f ms, p90 %.3f ms, "
+	       "p99 %.3f ms, max %.3f ms\n", sum / count,
+	       percentile(times, count, 50.0), percentile(times, count, 90.0),
+	       percentile(times, count, 99.0), times[count - 1]);
+	getrusage(RUSAGE_SELF, &usage);
+	cpu = timeval_to_seconds(&usage.ru_utime) -
+	      timeval_to_seconds(&window->run.rusage.ru_utime) +
+	      timeval_to_seconds(&usage.ru_stime) -
+	      timeval_to_seconds(&window->run.rusage.ru_stime);
+	printf("cpu time: %.3f seconds, %.3f ms/frame, %.1f frames/CPU-second\n",
+	       cpu, 1000.0 * cpu / count, cpu > 0.0 ? count / cpu : 0.0);
+	if (window->throttled_total > 0.0)
+		printf("throttled: %.2f seconds, not included above\n",
+		       window->throttled_total / 1000.0);
+}
+
+/**
+ * Returns the time of an input event on the monotonic clock in ms.
+ *
+ * Compositors commonly stamp input with the monotonic clock. When the
+ * timestamp is not plausible for that clock, the receive time is used.
+ *
+ * @param time the timestamp of the event in ms
+ */
+static double
+input_event_time(uint32_t time)
+{
+	double now = get_time_ms();
+	uint32_t age = (uint32_t) (uint64_t) now - time;
+
+	return age < 1000 ? now - age : now;
+}
+
+static void
+add_latency_sample(struct window *window, double latency)
+{
+	if (window->latency.count == window->latency.capacity) {
+		window->latency.capacity = window->latency.capacity ?
+					   window->latency.capacity * 2 : 256;
+		window->latency.samples = realloc(window->latency.samples,
+						  window->latency.capacity *
+						  sizeof(*window->latency.samples));
+		assert(window->latency.samples);
+	}
+
+	window->latency.samples[window->latency.count++] = latency;
+}
+
+/**
+ * Struct tracking the presentation of a frame that used input.
+ */
+struct latency_feedback {
+	struct window *window;
+	struct wp_presentation_feedback *feedback;
+	/** The time of the oldest input the frame used in ms */
+	double input_time;
+};
+
+static void
+feedback_sync_output(void *data, struct wp_presentation_feedback *feedback,
+		     struct wl_output *output)
+{
+}
+
+static void
+feedback_presented(void *data, struct wp_presentation_feedback *feedback,
+		   uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+		   uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo,
+		   uint32_t flags)
+{
+	struct latency_feedback *lf = data;
+	double sec = ((uint64_t) tv_sec_hi << 32 | tv_sec_lo);
+	double presented = sec * 1000.0 + tv_nsec / 1000000.0;
+
+	add_latency_sample(lf->window, presented - lf->input_time);
+	wp_presentation_feedback_destroy(feedback);
+	free(lf);
+}
+
+static void
+feedback_discarded(void *data, struct wp_presentation_feedback *feedback)
+{
+	struct latency_feedback *lf = data;
+
+	lf->window->latency.discarded++;
+	wp_presentation_feedback_destroy(feedback);
+	free(lf);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+	feedback_sync_output,
+	feedback_presented,
+	feedback_discarded,
+};
+
+/**
+ * Returns whether presentation times can be compared with the input
+ * times, which are on the monotonic clock. Otherwise, the latency is
+ * measured up to the buffer swap.
+ */
+static bool
+presentation_timing(struct display *display)
+{
+	return display->presentation &&
+	       display->presentation_clock == CLOCK_MONOTONIC;
+}
+
+/**
+ * Asks for the presentation time of the next commit of the window.
+ *
+ * @param window the window drawing a frame that used input
+ * @param input_time the time of the oldest input the frame used in ms
+ *
+ * @return false if presentation feedback is unavailable
+ */
+static bool
+request_latency_feedback(struct window *window, double input_time)
+{
+	struct display *display = window->display;
+	struct latency_feedback *lf;
+
+	if (!presentation_timing(display))
+		return false;
+
+	lf = calloc(1, sizeof *lf);
+	assert(lf);
+	lf->window = window;
+	lf->input_time = input_time;
+	lf->feedback = wp_presentation_feedback(display->presentation,
+						window->surface);
+	wp_presentation_feedback_add_listener(lf->feedback, &feedback_listener, lf);
+
+	return true;
+}
+
+/**
+ * Prints the input to display latency percentiles of the interval.
+ *
+ * @param window the window to report on
+ */
+static void
+print_latency(struct window *window)
+{
+	double *samples = window->latency.samples;
+	int count = window->latency.count;
+
+	if (count == 0 && window->latency.discarded == 0)
+		return;
+
+	if (count > 0) {
+		qsort(samples, count, sizeof(*samples), compare_doubles);
+		printf("input latency (%s): %d frames, p50 %.2f ms, p90 %.2f ms, "
+		       "p99 %.2f ms, max %.2f ms",
+		       presentation_timing(window->display) ?
+		       "presentation" : "swap", count,
+		       percentile(samples, count, 50.0),
+		       percentile(samples, count, 90.0),
+		       percentile(samples, count, 99.0), samples[count - 1]);
+	} else {
+		printf("input latency: no frames presented");
+	}
+	printf(", %ld discarded\n", window->latency.discarded);
 
-	/* Set the viewport */
-	glViewport(0, 0, (GLint) window->geometry.width, (GLint) window->geometry.height);
+	window->latency.count = 0;
+	window->latency.discarded = 0;
 }
 
+/**
+ * Waits until fewer than the maximum number of GL frames are queued.
+ *
+ * The CPU prepares the next frame while the GPU still works on the
+ * previous ones, up to the frames in flight limit.
+ *
+ * @param window the window about to draw
+ */
 static void
-handle_toplevel_close(void *data, struct xdg_toplevel *xdg_toplevel)
+begin_gl_frame(struct window *window)
 {
-	running = 0;
+	struct display *display = window->display;
+	EGLSyncKHR *fence;
+	double start;
+	int i;
+
+	if (!window->pipeline.fences)
+		return;
+
+	for (i = 0; i < window->frames_in_flight; i++)
+		if (window->pipeline.fences[i] != EGL_NO_SYNC_KHR &&
+		    display->egl.client_wait_sync(display->egl.dpy,
+						  window->pipeline.fences[i],
+						  0, 0) == EGL_TIMEOUT_EXPIRED_KHR)
+			window->pipeline.queued++;
+
+	fence = &window->pipeline.fences[window->pipeline.next];
+	if (*fence == EGL_NO_SYNC_KHR)
+		return;
+
+	start = get_time_ms();
+	display->egl.client_wait_sync(display->egl.dpy, *fence,
+				      EGL_SYNC_FLUSH_COMMANDS_BIT_KHR,
+				      EGL_FOREVER_KHR);
+	window->pipeline.blocked += get_time_ms() - start;
+
+	display->egl.destroy_sync(display->egl.dpy, *fence);
+	*fence = EGL_NO_SYNC_KHR;
 }
 
+/**
+ * Fences the GL frame that was just swapped.
+ *
+ * @param window the window that swapped
+ */
 static void
-handle_toplevel_configure_bounds (void *data, struct xdg_toplevel *xdg_toplevel,
-                                  int32_t width, int32_t height)
+end_gl_frame(struct window *window)
 {
+	struct display *display = window->display;
+
+	if (!window->pipeline.fences)
+		return;
+
+	window->pipeline.fences[window->pipeline.next] =
+		display->egl.create_sync(display->egl.dpy, EGL_SYNC_FENCE_KHR,
+					 NULL);
+	window->pipeline.next = (window->pipeline.next + 1) %
+				window->frames_in_flight;
 }
 
-static void handle_wm_capabilities (void *data, struct xdg_toplevel *xdg_toplevel,
-                                    struct wl_array *capabilities)
+static void
+add_pacing_error(struct window *window, double error)
 {
-}
+	if (window->pacing.count == window->pacing.capacity) {
+		window->pacing.capacity = window->pacing.capacity ?
+					  window->pacing.capacity * 2 : 256;
+		window->pacing.errors = realloc(window->pacing.errors,
+						window->pacing.capacity *
+						sizeof(*window->pacing.errors));
+		assert(window->pacing.errors);
+	}
 
-static const struct xdg_toplevel_listener xdg_toplevel_listener = {
-	handle_toplevel_configure,
-	handle_toplevel_close,
-	handle_toplevel_configure_bounds,
-	handle_wm_capabilities,
-};
+	window->pacing.errors[window->pacing.count++] = error;
+}
 
+/**
+ * Waits until the start of the next frame when the frame rate is capped.
+ *
+ * The deadlines are absolute timerfd expirations, so oversleeping does
+ * not accumulate, and events are dispatched while waiting. The last part
+ * of the wait can be spun to avoid the wake up latency of the scheduler.
+ * When a deadline is missed by more than a frame, the schedule restarts
+ * from the current time instead of catching up.
+ *
+ * @param window the window about to draw
+ */
 static void
-create_surface(struct window *window)
+pace_frame(struct window *window)
 {
 	struct display *display = window->display;
-	EGLBoolean ret;
-
-	window->surface = wl_compositor_create_surface(display->compositor);
-
-	window->native =
-		wl_egl_window_create(window->surface,
-					  window->geometry.width,
-					  window->geometry.height);
-	window->egl_surface =
-		eglCreatePlatformWindowSurface(display->egl.dpy,
-							display->egl.conf,
-							window->native, NULL);
-
-	window->xdg_surface = xdg_wm_base_get_xdg_surface(display->wm_base,
-							  window->surface);
-	xdg_surface_add_listener(window->xdg_surface,
-				 &xdg_surface_listener, window);
+	int64_t now = get_time_ns(), wake;
+	struct itimerspec timer = { 0 };
 
-	window->xdg_toplevel =
-		xdg_surface_get_toplevel(window->xdg_surface);
-	xdg_toplevel_add_listener(window->xdg_toplevel,
-				  &xdg_toplevel_listener, window);
+	if (window->pacing.interval == 0)
+		return;
 
-	xdg_toplevel_set_title(window->xdg_toplevel, "Wayland Gears");
+	if (window->pacing.deadline == 0) {
+		window->pacing.deadline = now;
+		return;
+	}
 
-	window->wait_for_configure = true;
-	wl_surface_commit(window->surface);
+	window->pacing.deadline += window->pacing.interval;
+	if (now - window->pacing.deadline > window->pacing.interval) {
+		window->pacing.deadline = now;
+		window->pacing.missed++;
+		return;
+	}
 
-	ret = eglMakeCurrent(window->display->egl.dpy, window->egl_surface,
-				  window->egl_surface, window->display->egl.ctx);
-	assert(ret == EGL_TRUE);
+	wake = window->pacing.deadline - window->pacing.spin;
+	if (wake > now) {
+		timer.it_value.tv_sec = wake / 1000000000;
+		timer.it_value.tv_nsec = wake % 1000000000;
+		display->loop.timer_expired = false;
+		timerfd_settime(display->loop.timer_fd, TFD_TIMER_ABSTIME,
+				&timer, NULL);
+		while (running && !display->loop.timer_expired)
+			if (wait_events(display, -1) < 0)
+				return;
+	}
 
-	if (!window->frame_sync)
-		eglSwapInterval(display->egl.dpy, 0);
+	do
+		now = get_time_ns();
+	while (now < window->pacing.deadline);
 
-	if (!display->wm_base)
-		return;
+	add_pacing_error(window, (now - window->pacing.deadline) / 1000.0);
+}
 
-	if (window->fullscreen)
-		xdg_toplevel_set_fullscreen(window->xdg_toplevel, NULL);
+/**
+ * Prints the CPU time spent by all threads of the process in the interval.
+ *
+ * @param window the window to report on
+ * @param seconds the length of the interval
+ */
+static void
+print_cpu_usage(struct window *window, double seconds)
+{
+	struct rusage usage;
+	double user, system, cpu;
+
+	getrusage(RUSAGE_SELF, &usage);
+	user = timeval_to_seconds(&usage.ru_utime) -
+	       timeval_to_seconds(&window->rusage.ru_utime);
+	system = timeval_to_seconds(&usage.ru_stime) -
+		 timeval_to_seconds(&window->rusage.ru_stime);
+	cpu = user + system;
+
+	printf("cpu: user %.2f s, system %.2f s, %.0f%% of a core, "
+	       "%.3f ms/frame, %.1f frames/CPU-second\n", user, system,
+	       100.0 * cpu / seconds, 1000.0 * cpu / window->frames,
+	       cpu > 0.0 ? window->frames / cpu : 0.0);
+	printf("context switches: %.1f voluntary, %.1f involuntary per second\n",
+	       (usage.ru_nvcsw - window->rusage.ru_nvcsw) / seconds,
+	       (usage.ru_nivcsw - window->rusage.ru_nivcsw) / seconds);
+
+	window->rusage = usage;
 }
 
+/**
+ * Prints how closely the frames of the interval started on their deadlines.
+ *
+ * @param window the window to report on
+ */
 static void
-destroy_surface(struct window *window)
+print_pacing(struct window *window)
 {
-	/* Required, otherwise segfault in egl_dri2.c: dri2_make_current()
-	 * on eglReleaseThread(). */
-	eglMakeCurrent(window->display->egl.dpy, EGL_NO_SURFACE, EGL_NO_SURFACE,
-				 EGL_NO_CONTEXT);
+	double *errors = window->pacing.errors;
+	int count = window->pacing.count;
+	double sum = 0.0;
+	int i;
 
-	eglDestroySurface(window->display->egl.dpy,
-						 window->egl_surface);
-	wl_egl_window_destroy(window->native);
+	if (window->pacing.interval == 0)
+		return;
 
-	if (window->xdg_toplevel)
-		xdg_toplevel_destroy(window->xdg_toplevel);
-	if (window->xdg_surface)
-		xdg_surface_destroy(window->xdg_surface);
-	wl_surface_destroy(window->surface);
+	if (count > 0) {
+		qsort(errors, count, sizeof(*errors), compare_doubles);
+		for (i = 0; i < count; i++)
+			sum += errors[i];
+		printf("pacing: %.3f ms interval, wake up error mean %.1f us, "
+		       "p50 %.1f us, p99 %.1f us, max %.1f us",
+		       window->pacing.interval / 1000000.0, sum / count,
+		       percentile(errors, count, 50.0),
+		       percentile(errors, count, 99.0), errors[count - 1]);
+	} else {
+		printf("pacing: %.3f ms interval, no deadline met",
+		       window->pacing.interval / 1000000.0);
+	}
+	printf(", %ld missed\n", window->pacing.missed);
 
-	if (window->callback)
-		wl_callback_destroy(window->callback);
+	window->pacing.count = 0;
+	window->pacing.missed = 0;
 }
 
 static void
@@ -987,19 +2753,33 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 {
 	struct window *window = data;
 	struct display *display = window->display;
-	static const GLfloat red[4] = { 0.8, 0.1, 0.0, 1.0 };
-	static const GLfloat green[4] = { 0.0, 0.8, 0.2, 1.0 };
-	static const GLfloat blue[4] = { 0.2, 0.2, 1.0, 1.0 };
+	struct shm_buffer *buffer = NULL;
 	GLfloat transform[16];
-	identity(transform);
+	uint64_t span;
+	double input_time = 0.0;
+	bool feedback = false;
+
+	if (window->backend == BACKEND_CPU) {
+		span = trace_begin();
+		buffer = begin_cpu_frame(window);
+		trace_end("wait for buffer", span);
+		if (!buffer) {
+			running = 0;
+			return;
+		}
+	} else if (window->backend == BACKEND_GL) {
+		span = trace_begin();
+		begin_gl_frame(window);
+		trace_end("wait for fence", span);
 
-	glClearColor(0.0, 0.0, 0.0, 0.0);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
 	struct wl_region *region;
 	EGLint buffer_age = 0;
 	EGLint rect[4];
 
-	usleep(window->delay);
+	span = trace_begin();
 	static double tRot0 = -1.0, tRate0 = -1.0;
 	struct timeval  tv;
 	gettimeofday(&tv, NULL);
@@ -1018,15 +2798,33 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 
 
 	/* Translate and rotate the view */
-	translate(transform, 0, 0, -40);
-	rotate(transform, 2 * M_PI * view_rot[0] / 360.0, 1, 0, 0);
-	rotate(transform, 2 * M_PI * view_rot[1] / 360.0, 0, 1, 0);
-	rotate(transform, 2 * M_PI * view_rot[2] / 360.0, 0, 0, 1);
+	update_view(transform);
+	if (scene_state)
+		update_scene(window, transform);
+	trace_end("matrix setup", span);
+
+	/* This frame is the first to show the pending input */
+	if (window->latency.pending > 0.0) {
+		input_time = window->latency.pending;
+		window->latency.pending = 0.0;
+		feedback = request_latency_feedback(window, input_time);
+	}
+
+	/* Frame callbacks stop arriving when the window is hidden */
+	if (!window->callback)
+		request_frame_callback(window);
 
 	/* Draw the gears */
-	draw_gear(gear1, transform, -3.0, -2.0, angle, red);
-	draw_gear(gear2, transform, 3.1, -2.0, -2 * angle - 9.0, green);
-	draw_gear(gear3, transform, -3.1, 4.2, -2 * angle - 25.0, blue);
+	span = trace_begin();
+	if (window->backend == BACKEND_CPU)
+		draw_scene_cpu(window, transform);
+#ifdef HAVE_VULKAN
+	else if (window->backend == BACKEND_VULKAN)
+		draw_scene_vulkan(window, transform);
+#endif
+	else
+		draw_scene(window, transform);
+	trace_end("draw scene", span);
 
 	if (window->opaque || window->fullscreen) {
 		region = wl_compositor_create_region(window->display->compositor);
@@ -1039,7 +2837,12 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 		wl_surface_set_opaque_region(window->surface, NULL);
 	}
 
-	if (display->swap_buffers_with_damage && buffer_age > 0) {
+	span = trace_begin();
+	if (window->backend == BACKEND_CPU) {
+		end_cpu_frame(window, buffer);
+	} else if (window->backend == BACKEND_VULKAN) {
+		/* vkrender_draw() presented already */
+	} else if (display->swap_buffers_with_damage && buffer_age > 0) {
 		rect[0] = window->geometry.width / 4 - 1;
 		rect[1] = window->geometry.height / 4 - 1;
 		rect[2] = window->geometry.width / 2 + 2;
@@ -1050,15 +2853,100 @@ redraw(void *data, struct wl_callback *callback, uint32_t time)
 	} else {
 		eglSwapBuffers(display->egl.dpy, window->egl_surface);
 	}
+	if (window->backend == BACKEND_GL)
+		end_gl_frame(window);
+	trace_end("swap", span);
 	window->frames++;
 
-	if (tRate0 < 0.0)
+	/* Without presentation feedback, the swap return has to do */
+	if (input_time > 0.0 && !feedback)
+		add_latency_sample(window, get_time_ms() - input_time);
+
+	if (window->dynres.target > 0)
+		update_dynamic_resolution(window);
+	if (window->run.duration > 0)
+		record_frame_time(window);
+
+	if (tRate0 < 0.0) {
 		tRate0 = t;
+		getrusage(RUSAGE_SELF, &window->rusage);
+	}
 	if (t - tRate0 >= 5.0) {
 		GLfloat seconds = t - tRate0;
 		GLfloat fps = window->frames / seconds;
 		printf("%d frames in %3.1f seconds = %6.3f FPS\n", window->frames, seconds,
 				fps);
+		print_cpu_usage(window, seconds);
+		if (window->backend == BACKEND_GL)
+			printf("gl: %.1f buffer binds, %.1f draw calls per frame\n",
+			       (double) arena.binds / window->frames,
+			       (double) arena.draws / window->frames);
+		arena.binds = arena.draws = 0;
+		printf("matrices: %.1f computed, %.1f reused per frame\n",
+		       (double) view.computed / window->frames,
+		       (double) view.skipped / window->frames);
+		view.computed = view.skipped = 0;
+		if (scene_state)
+			printf("update: %.3f ms/frame on %d threads, "
+			       "%.1f chunks stolen per frame\n",
+			       window->update.time / window->frames,
+			       pool_threads(update_pool),
+			       (double) window->update.steals / window->frames);
+		window->update.time = 0.0;
+		window->update.steals = 0;
+		if (window->pipeline.fences)
+			printf("pipeline: %d frames in flight, %.2f frames queued "
+			       "at frame start, %.3f ms/frame blocked on fences\n",
+			       window->frames_in_flight,
+			       (double) window->pipeline.queued / window->frames,
+			       window->pipeline.blocked / window->frames);
+		window->pipeline.queued = 0;
+		window->pipeline.blocked = 0.0;
+		printf("wakeups: %.1f per second, %.1f per frame\n",
+		       display->loop.wakeups / seconds,
+		       (double) display->loop.wakeups / window->frames);
+		display->loop.wakeups = 0;
+		if (window->dynres.target > 0) {
+			printf("render scale %.2f (%dx%d), %.1f ms over %.1f ms budget\n",
+			       window->dynres.scale, window->dynres.width,
+			       window->dynres.height, window->dynres.over_budget,
+			       window->dynres.target);
+			window->dynres.over_budget = 0;
+		}
+		if (window->lod || window->grid > 1 || window->cull ||
+		    window->occlusion)
+			printf("%d gears, LOD %s, %ld triangles/frame, %.3f ms/frame\n",
+			       scene_count, window->lod ? "on" : "off",
+			       window->triangles / window->frames,
+			       1000.0 * seconds / window->frames);
+		window->triangles = 0;
+		if (window->cull || window->occlusion)
+			printf("%.1f gears drawn, %.1f frustum culled, "
+			       "%.1f occluded per frame\n",
+			       (double) window->drawn / window->frames,
+			       (double) window->culled / window->frames,
+			       (double) window->occluded / window->frames);
+		window->drawn = window->culled = window->occluded = 0;
+		if (window->sort || window->depth_prepass)
+			printf("%s order, %.1f depth prepass draws/frame, "
+			       "%.3f ms/frame\n",
+			       window->sort ? "front-to-back" : "scene",
+			       (double) window->prepass_draws / window->frames,
+			       1000.0 * seconds / window->frames);
+		window->prepass_draws = 0;
+		if (window->throttled > 0.0)
+			printf("throttled %.2f seconds while hidden or suspended\n",
+			       window->throttled / 1000.0);
+		window->throttled = 0.0;
+		printf("dispatch: %.3f ms/frame, %.1f pointer events/frame, "
+		       "%.1f rotation updates/frame\n",
+		       window->dispatch_time / window->frames,
+		       (double) window->pointer_events / window->frames,
+		       (double) window->pointer_updates / window->frames);
+		window->dispatch_time = 0.0;
+		window->pointer_events = window->pointer_updates = 0;
+		print_latency(window);
+		print_pacing(window);
 		tRate0 = t;
 		window->frames = 0;
 	}
@@ -1099,43 +2987,158 @@ pointer_handle_leave(void *data, struct wl_pointer *pointer,
 }
 
 static int rotate_drag;
-static int last_pointer_x, last_pointer_y;
 
+/**
+ * Appends an input event to the recording, if any.
+ *
+ * @param display the display receiving the input
+ * @param type the type of the event
+ * @param a the first argument of the event
+ * @param b the second argument of the event
+ */
 static void
-pointer_handle_motion(void *data, struct wl_pointer *pointer,
-				uint32_t time, wl_fixed_t sx, wl_fixed_t sy)
+record_input(struct display *display, enum input_type type,
+	     int32_t a, int32_t b)
+{
+	double time = 0.0;
+
+	if (!display->input.record)
+		return;
+
+	/* Input arriving before the first frame replays at its start */
+	if (display->input.epoch > 0.0)
+		time = get_time_ms() - display->input.epoch;
+
+	fprintf(display->input.record, "%.3f %s %d %d\n", time,
+		input_names[type], a, b);
+}
+
+/**
+ * Applies the pointer motion accumulated since the last pointer frame.
+ *
+ * Relative motion is preferred while dragging, as it keeps going when the
+ * pointer hits the edge of the window.
+ *
+ * @param display the display receiving the input
+ */
+static void
+apply_pointer_frame(struct display *display)
 {
-	int x = wl_fixed_to_int(sx);
-	int y = wl_fixed_to_int(sy);
+	struct window *window = display->window;
+	double dx, dy;
+
+	if (!display->pointer_frame.motion && !display->pointer_frame.relative)
+		return;
 
 	if (rotate_drag)
 	{
-		view_rot[0] += (y - last_pointer_y) * 0.5;
-		view_rot[1] += (x - last_pointer_x) * 0.5;
+		if (display->pointer_frame.relative) {
+			dx = display->pointer_frame.dx;
+			dy = display->pointer_frame.dy;
+		} else {
+			dx = wl_fixed_to_double(display->pointer_frame.x -
+						display->pointer_frame.applied_x);
+			dy = wl_fixed_to_double(display->pointer_frame.y -
+						display->pointer_frame.applied_y);
+		}
+
+		view_rot[0] += dy * 0.5;
+		view_rot[1] += dx * 0.5;
+		window->pointer_updates++;
+
+		if (window->latency.pending == 0.0)
+			window->latency.pending = display->pointer_frame.time;
 	}
 
-	last_pointer_x = x;
-	last_pointer_y = y;
+	display->pointer_frame.applied_x = display->pointer_frame.x;
+	display->pointer_frame.applied_y = display->pointer_frame.y;
+	display->pointer_frame.dx = display->pointer_frame.dy = 0.0;
+	display->pointer_frame.motion = display->pointer_frame.relative = false;
+}
+
+/**
+ * Notes the time of the first motion of a pointer frame.
+ *
+ * @param display the display receiving the input
+ * @param time the time of the motion on the monotonic clock in ms
+ */
+static void
+start_pointer_frame(struct display *display, double time)
+{
+	if (!display->pointer_frame.motion && !display->pointer_frame.relative)
+		display->pointer_frame.time = time;
+	display->window->pointer_events++;
+}
+
+static void
+pointer_handle_motion(void *data, struct wl_pointer *pointer,
+				uint32_t time, wl_fixed_t sx, wl_fixed_t sy)
+{
+	struct display *display = data;
+	uint64_t t = trace_begin();
+
+	record_input(display, INPUT_MOTION, sx, sy);
+
+	start_pointer_frame(display, input_event_time(time));
+	display->pointer_frame.x = sx;
+	display->pointer_frame.y = sy;
+	display->pointer_frame.motion = true;
+
+	/* Before version 5, every event is a frame of its own */
+	if (pointer && display->seat_version < WL_POINTER_FRAME_SINCE_VERSION)
+		apply_pointer_frame(display);
+
+	trace_end("pointer motion", t);
+}
+
+static void
+relative_pointer_handle_motion(void *data,
+			       struct zwp_relative_pointer_v1 *relative_pointer,
+			       uint32_t utime_hi, uint32_t utime_lo,
+			       wl_fixed_t dx, wl_fixed_t dy,
+			       wl_fixed_t dx_unaccel, wl_fixed_t dy_unaccel)
+{
+	struct display *display = data;
+	uint64_t utime = (uint64_t) utime_hi << 32 | utime_lo;
+
+	record_input(display, INPUT_RELATIVE, dx, dy);
+
+	start_pointer_frame(display, input_event_time(utime / 1000));
+	display->pointer_frame.dx += wl_fixed_to_double(dx);
+	display->pointer_frame.dy += wl_fixed_to_double(dy);
+	display->pointer_frame.relative = true;
 }
 
+static const struct zwp_relative_pointer_v1_listener relative_pointer_listener = {
+	relative_pointer_handle_motion,
+};
+
 static void
 pointer_handle_button(void *data, struct wl_pointer *wl_pointer,
 				uint32_t serial, uint32_t time, uint32_t button,
 				uint32_t state)
 {
 	struct display *display = data;
+	uint64_t t;
 
 	if (!display->window->xdg_toplevel)
 		return;
 
+	t = trace_begin();
+	record_input(display, INPUT_BUTTON, button, state);
+
 	if (button == BTN_RIGHT)
 	{
 		rotate_drag = state == WL_POINTER_BUTTON_STATE_PRESSED;
 	}
 
-	if (button == BTN_LEFT && state == WL_POINTER_BUTTON_STATE_PRESSED)
+	/* A replayed press has no serial to start a move with */
+	if (button == BTN_LEFT && state == WL_POINTER_BUTTON_STATE_PRESSED &&
+	    wl_pointer)
 		xdg_toplevel_move(display->window->xdg_toplevel,
 				  display->seat, serial);
+
+	trace_end("pointer button", t);
 }
 
 static void
@@ -1146,6 +3149,25 @@ pointer_handle_axis(void *data, struct wl_pointer *wl_pointer,
 
 static void
 pointer_handle_frame(void *data, struct wl_pointer *wl_pointer)
+{
+	apply_pointer_frame(data);
+}
+
+static void
+pointer_handle_axis_source(void *data, struct wl_pointer *wl_pointer,
+			   uint32_t axis_source)
+{
+}
+
+static void
+pointer_handle_axis_stop(void *data, struct wl_pointer *wl_pointer,
+			 uint32_t time, uint32_t axis)
+{
+}
+
+static void
+pointer_handle_axis_discrete(void *data, struct wl_pointer *wl_pointer,
+			     uint32_t axis, int32_t discrete)
 {
 }
 
@@ -1155,7 +3177,10 @@ static const struct wl_pointer_listener pointer_listener = {
 	pointer_handle_motion,
 	pointer_handle_button,
 	pointer_handle_axis,
-	.frame = pointer_handle_frame,
+	pointer_handle_frame,
+	pointer_handle_axis_source,
+	pointer_handle_axis_stop,
+	pointer_handle_axis_discrete,
 };
 
 static void
@@ -1164,11 +3189,14 @@ touch_handle_down(void *data, struct wl_touch *wl_touch,
 		  int32_t id, wl_fixed_t x_w, wl_fixed_t y_w)
 {
 	struct display *d = (struct display *)data;
+	uint64_t t;
 
 	if (!d->wm_base)
 		return;
 
+	t = trace_begin();
 	xdg_toplevel_move(d->window->xdg_toplevel, d->seat, serial);
+	trace_end("touch down", t);
 }
 
 static void
@@ -1235,10 +3263,14 @@ keyboard_handle_key(void *data, struct wl_keyboard *keyboard,
 			 uint32_t state)
 {
 	struct display *d = data;
+	uint64_t t;
 
 	if (!d->wm_base)
 		return;
 
+	t = trace_begin();
+	record_input(d, INPUT_KEY, key, state);
+
 	if (key == KEY_F11 && state) {
 		if (d->window->fullscreen)
 			xdg_toplevel_unset_fullscreen(d->window->xdg_toplevel);
@@ -1246,6 +3278,8 @@ keyboard_handle_key(void *data, struct wl_keyboard *keyboard,
 			xdg_toplevel_set_fullscreen(d->window->xdg_toplevel, NULL);
 	} else if (key == KEY_ESC && state)
 		running = 0;
+
+	trace_end("keyboard key", t);
 }
 
 static void
@@ -1277,10 +3311,29 @@ seat_handle_capabilities(void *data, struct wl_seat *seat,
 {
 	struct display *d = data;
 
+	/* Live input would make the replay nondeterministic */
+	if (d->input.replay)
+		return;
+
 	if ((caps & WL_SEAT_CAPABILITY_POINTER) && !d->pointer) {
 		d->pointer = wl_seat_get_pointer(seat);
 		wl_pointer_add_listener(d->pointer, &pointer_listener, d);
+
+		/* Relative motion is only coalesced with pointer frames */
+		if (d->relative_pointer_manager &&
+		    d->seat_version >= WL_POINTER_FRAME_SINCE_VERSION) {
+			d->relative_pointer =
+				zwp_relative_pointer_manager_v1_get_relative_pointer(
+					d->relative_pointer_manager, d->pointer);
+			zwp_relative_pointer_v1_add_listener(d->relative_pointer,
+							     &relative_pointer_listener,
+							     d);
+		}
 	} else if (!(caps & WL_SEAT_CAPABILITY_POINTER) && d->pointer) {
+		if (d->relative_pointer) {
+			zwp_relative_pointer_v1_destroy(d->relative_pointer);
+			d->relative_pointer = NULL;
+		}
 		wl_pointer_destroy(d->pointer);
 		d->pointer = NULL;
 	}
@@ -1323,6 +3376,19 @@ static const struct xdg_wm_base_listener wm_base_listener = {
 	xdg_wm_base_ping,
 };
 
+static void
+presentation_clock_id(void *data, struct wp_presentation *presentation,
+		      uint32_t clk_id)
+{
+	struct display *d = data;
+
+	d->presentation_clock = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+	presentation_clock_id,
+};
+
 static void
 registry_handle_global(void *data, struct wl_registry *registry,
 				 uint32_t name, const char *interface, uint32_t version)
@@ -1336,11 +3402,13 @@ registry_handle_global(void *data, struct wl_registry *registry,
 					 MIN(version, 4));
 	} else if (strcmp(interface, "xdg_wm_base") == 0) {
 		d->wm_base = wl_registry_bind(registry, name,
-							&xdg_wm_base_interface, 1);
+					      &xdg_wm_base_interface,
+					      MIN(version, XDG_WM_BASE_VERSION));
 		xdg_wm_base_add_listener(d->wm_base, &wm_base_listener, d);
 	} else if (strcmp(interface, "wl_seat") == 0) {
+		d->seat_version = MIN(version, 5);
 		d->seat = wl_registry_bind(registry, name,
-						&wl_seat_interface, 1);
+						&wl_seat_interface, d->seat_version);
 		wl_seat_add_listener(d->seat, &seat_listener, d);
 	} else if (strcmp(interface, "wl_shm") == 0) {
 		d->shm = wl_registry_bind(registry, name,
@@ -1356,6 +3424,18 @@ registry_handle_global(void *data, struct wl_registry *registry,
 			fprintf(stderr, "unable to load default left pointer\n");
 			// TODO: abort ?
 		}
+	} else if (strcmp(interface, "wp_viewporter") == 0) {
+		d->viewporter = wl_registry_bind(registry, name,
+						 &wp_viewporter_interface, 1);
+	} else if (strcmp(interface, "zwp_relative_pointer_manager_v1") == 0) {
+		d->relative_pointer_manager =
+			wl_registry_bind(registry, name,
+					 &zwp_relative_pointer_manager_v1_interface, 1);
+	} else if (strcmp(interface, "wp_presentation") == 0) {
+		d->presentation = wl_registry_bind(registry, name,
+						   &wp_presentation_interface, 1);
+		wp_presentation_add_listener(d->presentation,
+					     &presentation_listener, d);
 	}
 }
 
@@ -1370,21 +3450,193 @@ static const struct wl_registry_listener registry_listener = {
 	registry_handle_global_remove
 };
 
+/**
+ * Waits until the window should draw its next frame.
+ *
+ * When syncing to the compositor, waits for the frame callback of the
+ * previous frame. Otherwise, only waits once the callback is overdue,
+ * as the compositor stops sending them while the window is hidden. A
+ * suspended window waits until the compositor resumes it.
+ *
+ * Time spent hidden or suspended is reported as throttled and left out
+ * of the frame times of a timed run.
+ *
+ * @param window the window about to draw
+ *
+ * @return -1 on failure
+ */
+static int
+wait_for_frame(struct window *window)
+{
+	struct display *display = window->display;
+	double start = get_time_ms(), waited;
+	bool throttled = window->suspended ||
+			 (window->callback &&
+			  start - window->callback_time >= FRAME_CALLBACK_TIMEOUT);
+	int ret = 0;
+
+	while (running && ret != -1 &&
+	       (window->suspended ||
+		(window->callback && (window->frame_sync || throttled))))
+		ret = wait_events(display, -1);
+
+	waited = get_time_ms() - start;
+	if (throttled || waited >= FRAME_CALLBACK_TIMEOUT) {
+		window->throttled += waited;
+		window->throttled_total += waited;
+		if (window->run.start > 0.0) {
+			window->run.start += waited;
+			window->run.last += waited;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * Loads an input recording.
+ *
+ * @param display the display to replay the input into
+ * @param path the recording written by --record
+ */
+static void
+load_input(struct display *display, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	struct recorded_input *event;
+	char line[128], type[16];
+	int capacity = 0, n;
+
+	if (!f) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	while (fgets(line, sizeof line, f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		if (display->input.count == capacity) {
+			capacity = capacity ? capacity * 2 : 256;
+			display->input.replay = realloc(display->input.replay,
+							capacity * sizeof(*event));
+			assert(display->input.replay);
+		}
+
+		event = &display->input.replay[display->input.count];
+		if (sscanf(line, "%lf %15s %d %d", &event->time, type,
+			   &event->a, &event->b) != 4) {
+			fprintf(stderr, "%s: malformed event: %s", path, line);
+			exit(EXIT_FAILURE);
+		}
+
+		for (n = 0; n < (int) ARRAY_LENGTH(input_names); n++)
+			if (strcmp(type, input_names[n]) == 0)
+				break;
+		if (n == (int) ARRAY_LENGTH(input_names)) {
+			fprintf(stderr, "%s: unknown event: %s", path, line);
+			exit(EXIT_FAILURE);
+		}
+		event->type = n;
+		display->input.count++;
+	}
+
+	fclose(f);
+}
+
+/**
+ * Feeds the recorded events that are due into the input handlers.
+ *
+ * The run ends once all events have been replayed.
+ *
+ * @param display the display to replay the input into
+ */
 static void
-signal_int(int signum)
+replay_input(struct display *display)
 {
+	double now = get_time_ms() - display->input.epoch;
+	struct recorded_input *event;
+	uint64_t utime;
+
+	while (display->input.next < display->input.count) {
+		event = &display->input.replay[display->input.next];
+		if (event->time > now)
+			break;
+		display->input.next++;
+
+		switch (event->type) {
+		case INPUT_MOTION:
+			pointer_handle_motion(display, NULL, event->time,
+					      event->a, event->b);
+			break;
+		case INPUT_BUTTON:
+			pointer_handle_button(display, NULL, 0, event->time,
+					      event->a, event->b);
+			break;
+		case INPUT_KEY:
+			keyboard_handle_key(display, NULL, 0, event->time,
+					    event->a, event->b);
+			break;
+		case INPUT_RELATIVE:
+			/* The microsecond timestamp overflows 32 bits */
+			utime = (uint64_t) (event->time * 1000);
+			relative_pointer_handle_motion(display, NULL,
+						       utime >> 32,
+						       utime & 0xffffffff,
+						       event->a, event->b, 0, 0);
+			break;
+		}
+	}
+
+	/* The recording has no pointer frames, the due motion is one frame */
+	apply_pointer_frame(display);
+	if (display->input.next < display->input.count)
+		return;
+
+	printf("replayed %d input events\n", display->input.count);
 	running = 0;
 }
 
+#ifdef HAVE_VULKAN
+#define BACKEND_USAGE \
+	"  --backend <gl|cpu|vulkan>\tRender with GLES2, the CPU rasterizer or Vulkan\n"
+#else
+#define BACKEND_USAGE \
+	"  --backend <gl|cpu>\tRender with GLES2 or the CPU rasterizer\n"
+#endif
+
 static void
 usage(int error_code)
 {
 	fprintf(stderr, "Usage: simple-egl [OPTIONS]\n\n"
-		"  -d <us>\tBuffer swap delay in microseconds\n"
+		"  -d <us>\tStart frames at least us microseconds apart, as --fps-cap\n"
 		"  -f\tRun in fullscreen mode\n"
 		"  -o\tCreate an opaque surface\n"
 		"  -s\tUse a 16 bpp EGL config\n"
 		"  -b\tDon't sync to compositor redraw (eglSwapInterval 0)\n"
+		"  --size <w>x<h>\tInitial window size\n"
+		"  --duration <s>\tExit after s seconds and print frame time statistics\n"
+		"  --fps-cap <fps>\tStart frames at a fixed rate on absolute deadlines\n"
+		"  --fps-spin <us>\tSpin instead of sleeping for the last us before each frame\n"
+		"  --trace <file>\tWrite a Chrome trace of the frame phases at exit\n"
+		"  --record <file>\tRecord pointer and keyboard input\n"
+		"  --replay <file>\tReplay recorded input at its original timing, then exit\n"
+		"  --target-frame-time <ms>\tScale the render resolution to hold a frame time\n"
+		"  --grid <n>\tDraw an n x n grid of gear trains\n"
+		"  --scene <file>\tLoad the gear train from a scene file\n"
+		"  --keep-meshes\tKeep the CPU copies of uploaded meshes\n"
+		"  --lod\tPick the gear mesh detail from the projected size\n"
+		"  --cull\tSkip gears outside of the view frustum\n"
+		"  --occlusion\tSkip hidden gears using occlusion queries\n"
+		"  --sort\tDraw the gears front to back\n"
+		"  --depth-prepass\tLay down depth before shading\n"
+		"  --per-pixel\tUse per-pixel Phong shading\n"
+		"  --lights <n>\tNumber of directional lights (1-8)\n"
+		"  --alu <n>\tExtra ALU loop iterations per fragment\n"
+		BACKEND_USAGE
+		"  --threads <n>\tNumber of CPU rasterizer threads\n"
+		"  --update-threads <n>\tUpdate the gear matrices on n threads up front\n"
+		"  --frames-in-flight <n>\tMaximum number of frames queued on the GPU\n"
 		"  -h\tThis help text\n\n");
 
 	exit(error_code);
@@ -1393,9 +3645,10 @@ usage(int error_code)
 int
 main(int argc, char **argv)
 {
-	struct sigaction sigint;
 	struct display display = { 0 };
 	struct window  window  = { 0 };
+	const char *trace_path = NULL, *record_path = NULL;
+	double fps_cap = 0.0, delay = 0.0;
 	int i, ret = 0;
 
 	window.display = &display;
@@ -1405,11 +3658,15 @@ main(int argc, char **argv)
 	window.window_size = window.geometry;
 	window.buffer_size = 32;
 	window.frame_sync = 1;
-	window.delay = 0;
+	window.dynres.scale = 1.0;
+	window.lights = 1;
+	window.backend = BACKEND_GL;
+	window.threads = sysconf(_SC_NPROCESSORS_ONLN);
+	window.frames_in_flight = 2;
 
 	for (i = 1; i < argc; i++) {
 		if (strcmp("-d", argv[i]) == 0 && i+1 < argc)
-			window.delay = atoi(argv[++i]);
+			delay = atof(argv[++i]);
 		else if (strcmp("-f", argv[i]) == 0)
 			window.fullscreen = 1;
 		else if (strcmp("-o", argv[i]) == 0)
@@ -1418,14 +3675,109 @@ main(int argc, char **argv)
 			window.buffer_size = 16;
 		else if (strcmp("-b", argv[i]) == 0)
 			window.frame_sync = 0;
+		else if (strcmp("--size", argv[i]) == 0 && i+1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &window.geometry.width,
+				   &window.geometry.height) != 2)
+				usage(EXIT_FAILURE);
+			window.window_size = window.geometry;
+		} else if (strcmp("--duration", argv[i]) == 0 && i+1 < argc)
+			window.run.duration = atof(argv[++i]);
+		else if (strcmp("--fps-cap", argv[i]) == 0 && i+1 < argc)
+			fps_cap = atof(argv[++i]);
+		else if (strcmp("--fps-spin", argv[i]) == 0 && i+1 < argc)
+			window.pacing.spin = atof(argv[++i]) * 1000.0;
+		else if (strcmp("--trace", argv[i]) == 0 && i+1 < argc)
+			trace_path = argv[++i];
+		else if (strcmp("--record", argv[i]) == 0 && i+1 < argc)
+			record_path = argv[++i];
+		else if (strcmp("--replay", argv[i]) == 0 && i+1 < argc)
+			load_input(&display, argv[++i]);
+		else if (strcmp("--target-frame-time", argv[i]) == 0 && i+1 < argc)
+			window.dynres.target = atof(argv[++i]);
+		else if (strcmp("--grid", argv[i]) == 0 && i+1 < argc)
+			window.grid = atoi(argv[++i]);
+		else if (strcmp("--scene", argv[i]) == 0 && i+1 < argc)
+			window.scene_path = argv[++i];
+		else if (strcmp("--keep-meshes", argv[i]) == 0)
+			window.keep_meshes = true;
+		else if (strcmp("--lod", argv[i]) == 0)
+			window.lod = 1;
+		else if (strcmp("--cull", argv[i]) == 0)
+			window.cull = 1;
+		else if (strcmp("--occlusion", argv[i]) == 0)
+			window.occlusion = 1;
+		else if (strcmp("--sort", argv[i]) == 0)
+			window.sort = 1;
+		else if (strcmp("--depth-prepass", argv[i]) == 0)
+			window.depth_prepass = 1;
+		else if (strcmp("--per-pixel", argv[i]) == 0)
+			window.per_pixel = 1;
+		else if (strcmp("--lights", argv[i]) == 0 && i+1 < argc)
+			window.lights = atoi(argv[++i]);
+		else if (strcmp("--alu", argv[i]) == 0 && i+1 < argc)
+			window.alu_loops = atoi(argv[++i]);
+		else if (strcmp("--backend", argv[i]) == 0 && i+1 < argc) {
+			i++;
+			if (strcmp("gl", argv[i]) == 0)
+				window.backend = BACKEND_GL;
+			else if (strcmp("cpu", argv[i]) == 0)
+				window.backend = BACKEND_CPU;
+#ifdef HAVE_VULKAN
+			else if (strcmp("vulkan", argv[i]) == 0)
+				window.backend = BACKEND_VULKAN;
+#endif
+			else
+				usage(EXIT_FAILURE);
+		} else if (strcmp("--threads", argv[i]) == 0 && i+1 < argc)
+			window.threads = atoi(argv[++i]);
+		else if (strcmp("--update-threads", argv[i]) == 0 && i+1 < argc)
+			window.update_threads = atoi(argv[++i]);
+		else if (strcmp("--frames-in-flight", argv[i]) == 0 && i+1 < argc)
+			window.frames_in_flight = atoi(argv[++i]);
 		else if (strcmp("-h", argv[i]) == 0)
 			usage(EXIT_SUCCESS);
 		else
 			usage(EXIT_FAILURE);
 	}
 
+	if (window.lights < 1 || window.lights > MAX_LIGHTS ||
+	    window.alu_loops < 0 || window.threads < 1 ||
+	    window.update_threads < 0 ||
+	    window.frames_in_flight < 1 || window.run.duration < 0 ||
+	    fps_cap < 0 || delay < 0 || window.pacing.spin < 0 ||
+	    window.geometry.width < 1 || window.geometry.height < 1)
+		usage(EXIT_FAILURE);
+
+	if (fps_cap > 0)
+		window.pacing.interval = 1000000000.0 / fps_cap;
+	/* -d paces frames like the cap, the longer interval wins */
+	if (delay * 1000.0 > window.pacing.interval)
+		window.pacing.interval = delay * 1000.0;
+
+	if (record_path && display.input.replay) {
+		fprintf(stderr, "--record and --replay are exclusive\n");
+		usage(EXIT_FAILURE);
+	}
+	if (record_path) {
+		display.input.record = fopen(record_path, "w");
+		if (!display.input.record) {
+			perror(record_path);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(display.input.record, "# wlgears input recording\n");
+	}
+
+	if (trace_path) {
+		if (!trace_init(trace_path, TRACE_EVENTS)) {
+			fprintf(stderr, "failed to allocate the trace buffer\n");
+			exit(EXIT_FAILURE);
+		}
+		trace_thread_name("main");
+	}
+
 	display.display = wl_display_connect(NULL);
 	assert(display.display);
+	init_event_loop(&display);
 
 	display.registry = wl_display_get_registry(display.display);
 	wl_registry_add_listener(display.registry,
@@ -1433,35 +3785,87 @@ main(int argc, char **argv)
 
 	wl_display_roundtrip(display.display);
 
-	init_egl(&display, &window);
-	create_surface(&window);
-	init_gl(&window);
+	if (window.backend == BACKEND_CPU) {
+		create_surface(&window);
+		init_cpu(&window);
+#ifdef HAVE_VULKAN
+	} else if (window.backend == BACKEND_VULKAN) {
+		create_surface(&window);
+		init_vulkan(&window);
+#endif
+	} else {
+		init_egl(&display, &window);
+		create_surface(&window);
+		init_gl(&window);
+	}
 
 	display.cursor_surface =
 		wl_compositor_create_surface(display.compositor);
 
-	sigint.sa_handler = signal_int;
-	sigemptyset(&sigint.sa_mask);
-	sigint.sa_flags = SA_RESETHAND;
-	sigaction(SIGINT, &sigint, NULL);
+	print_memory(&window);
 
-	/* The mainloop here is a little subtle.  Redrawing will cause
-	 * EGL to read events so we can just call
-	 * wl_display_dispatch_pending() to handle any events that got
-	 * queued up as a side effect. */
+	/* All waiting happens in the epoll set of the display: for the
+	 * configure, for frame callbacks, for the frame rate cap and for
+	 * buffers. Between frames, the events that are readable already are
+	 * dispatched without blocking. EGL and Vulkan read their own events
+	 * on private queues. */
 	while (running && ret != -1) {
+		double dispatch_start = get_time_ms();
+		uint64_t t = trace_begin();
+
 		if (window.wait_for_configure) {
-			ret = wl_display_dispatch(display.display);
+			ret = wait_events(&display, -1);
+			trace_end("dispatch", t);
 		} else {
-			ret = wl_display_dispatch_pending(display.display);
+			ret = dispatch_events(&display);
+			trace_end("dispatch", t);
+			window.dispatch_time += get_time_ms() - dispatch_start;
+
+			if (display.input.epoch == 0.0)
+				display.input.epoch = get_time_ms();
+			if (display.input.replay)
+				replay_input(&display);
+
+			t = trace_begin();
+			ret = wait_for_frame(&window);
+			trace_end("wait for frame", t);
+			if (ret == -1 || !running)
+				break;
+
+			t = trace_begin();
+			pace_frame(&window);
+			trace_end("pace", t);
+
+			t = trace_begin();
 			redraw(&window, NULL, 0);
+			trace_end("frame", t);
 		}
 	}
 
 	fprintf(stderr, "wl-gears exiting\n");
 
+	print_run_summary(&window);
+	print_memory(&window);
+	free(window.run.times);
+	free(window.latency.samples);
+	free(window.pacing.errors);
+
+	if (display.input.record)
+		fclose(display.input.record);
+	free(display.input.replay);
+
+	/* The GL objects go while the context is still current */
+	fini_scene(&window);
+#ifdef HAVE_VULKAN
+	/* The Vulkan surface has to go before the wl_surface */
+	if (window.vk)
+		vkrender_destroy(window.vk);
+#endif
 	destroy_surface(&window);
-	fini_egl(&display);
+	if (window.swrast)
+		swrast_destroy(window.swrast);
+	if (window.backend == BACKEND_GL)
+		fini_egl(&display);
 
 	wl_surface_destroy(display.cursor_surface);
 	if (display.cursor_theme)
@@ -1470,12 +3874,23 @@ main(int argc, char **argv)
 	if (display.wm_base)
 		xdg_wm_base_destroy(display.wm_base);
 
+	if (display.viewporter)
+		wp_viewporter_destroy(display.viewporter);
+	if (display.presentation)
+		wp_presentation_destroy(display.presentation);
+	if (display.relative_pointer_manager)
+		zwp_relative_pointer_manager_v1_destroy(display.relative_pointer_manager);
+
 	if (display.compositor)
 		wl_compositor_destroy(display.compositor);
 
 	wl_registry_destroy(display.registry);
 	wl_display_flush(display.display);
+	finish_event_loop(&display);
 	wl_display_disconnect(display.display);
 
+	/* The swrast workers have exited, all rings are complete */
+	trace_finish();
+
 	return 0;
 }